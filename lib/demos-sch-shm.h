@@ -0,0 +1,50 @@
+#ifndef DEMOSSCH_SHM_H
+#define DEMOSSCH_SHM_H
+
+#include <stdint.h>
+
+/*
+ * Layout of the memory shared between demos-sched and the process library.
+ *
+ * For each process, the scheduler creates two single-page memfds and passes their
+ * descriptors in `DEMOS_PARAMETERS`: the 4th field is the memfd with `struct demos_sch_info`,
+ * which is sealed against writes by the process (or passed read-only on kernels before 5.1),
+ * the 6th field is the memfd with `struct demos_sch_yield`, mapped read-write by the process.
+ * Both memfds are sealed against resizing. All fields are accessed with atomic builtins,
+ * as the pages are concurrently used by both sides.
+ */
+
+/**
+ * Scheduling state of the process, written only by the scheduler.
+ *
+ * Protected by a seqlock: `seq` is odd while an update is in progress, readers retry
+ * if it is odd or changed while they were copying the other fields.
+ * Times are absolute CLOCK_MONOTONIC values in nanoseconds.
+ */
+struct demos_sch_info
+{
+    uint32_t seq;
+    uint32_t window_index;
+    uint64_t major_frame;
+    /** Zero while the process is not scheduled. */
+    uint64_t budget_deadline_ns;
+    uint64_t window_end_ns;
+    /** Number of SC runs of the process that ended without completion. */
+    uint64_t overruns;
+};
+
+/** Continuation channel used with `futex_yield: yes` instead of an eventfd. */
+struct demos_sch_yield
+{
+    /**
+     * Set to 1 by the process library once it maps the page. Until then, the scheduler
+     * signals continuation through the eventfd, so that old binaries keep working.
+     */
+    uint32_t active;
+    /** Non-zero while the process is (about to be) blocked in FUTEX_WAIT on `continue_seq`. */
+    uint32_t waiting;
+    /** Futex word, incremented by the scheduler each time the process should continue. */
+    uint32_t continue_seq;
+};
+
+#endif // DEMOSSCH_SHM_H
@@ -1,9 +1,13 @@
 #include "demos-sch.h"
+#include "demos-sch-shm.h"
 #include <errno.h>
+#include <linux/futex.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #ifdef DEMOS_LIB_VERBOSE
@@ -23,6 +27,32 @@ static int fd_completed, fd_new_period;
 // indicates if `demos_init` was already called
 static bool demos_init_ran = false;
 static bool initialization_pending;
+// pages shared with the scheduler, NULL if not provided (older scheduler version)
+static const struct demos_sch_info *info_page = NULL;
+// shared page for futex-based continuation, NULL if not enabled for this process
+static struct demos_sch_yield *yield_page = NULL;
+
+static void map_shared_pages(int fd_info, int fd_yield)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    void *page = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd_info, 0);
+    if (page == MAP_FAILED) {
+        LOG_DEBUG("Warning: Failed to map the scheduling info page");
+    } else {
+        info_page = page;
+    }
+
+    if (fd_yield == -1) return;
+    page = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_yield, 0);
+    if (page == MAP_FAILED) {
+        // not fatal, the scheduler keeps using the eventfd until we activate the page
+        LOG_DEBUG("Warning: Failed to map the shared yield page, using eventfd");
+    } else {
+        yield_page = page;
+        __atomic_store_n(&yield_page->active, 1, __ATOMIC_SEQ_CST);
+        LOG_DEBUG("Using futex-based continuation");
+    }
+}
 
 int demos_init()
 {
@@ -37,13 +67,26 @@ int demos_init()
     }
 
     // need to use tmp int, scanf doesn't know boolean
-    int tmp_init_flag;
-    if (sscanf(str, "%d,%d,%d", &fd_completed, &fd_new_period, &tmp_init_flag) != 3) {
+    int tmp_init_flag, fd_info, tmp_futex_yield, fd_yield;
+    int n = sscanf(str,
+                   "%d,%d,%d,%d,%d,%d",
+                   &fd_completed,
+                   &fd_new_period,
+                   &tmp_init_flag,
+                   &fd_info,
+                   &tmp_futex_yield,
+                   &fd_yield);
+    if (n < 3) {
         LOG_DEBUG("Error: Failed to load configuration from DEMOS_PARAMETERS environment variable");
         errno = EBADMSG;
         return -1;
     }
 
+    // shared memory is not provided by older scheduler versions
+    if (n == 6) {
+        map_shared_pages(fd_info, tmp_futex_yield ? fd_yield : -1);
+    }
+
     initialization_pending = (bool)tmp_init_flag;
     LOG_DEBUG("Process %s an initialization window",
               initialization_pending ? "has" : "does not have");
@@ -52,6 +95,21 @@ int demos_init()
     return 0;
 }
 
+/** Blocks until the scheduler increments `continue_seq` in the shared page. */
+static int wait_for_continue(uint32_t seq)
+{
+    // the scheduler increments `continue_seq` before checking `waiting`, and we set
+    //  `waiting` before checking `continue_seq`, so at least one side sees the other
+    while (__atomic_load_n(&yield_page->continue_seq, __ATOMIC_SEQ_CST) == seq) {
+        // not FUTEX_PRIVATE_FLAG, the page is shared with another process
+        if (syscall(SYS_futex, &yield_page->continue_seq, FUTEX_WAIT, seq, NULL, NULL, 0) == -1 &&
+            errno != EAGAIN && errno != EINTR) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int demos_completed()
 {
     // to make the library usage as easy as possible, we check
@@ -71,14 +129,27 @@ int demos_completed()
     LOG_DEBUG("Notifying scheduler of completion and suspending process...");
 
     uint64_t buf = 1;
-    // notify demos
-    if (write(fd_completed, &buf, sizeof(buf)) == -1) {
-        return -1;
-    }
-
-    // block until become readable
-    if (read(fd_new_period, &buf, sizeof(buf)) == -1) {
-        return -1;
+    if (yield_page) {
+        uint32_t seq = __atomic_load_n(&yield_page->continue_seq, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&yield_page->waiting, 1, __ATOMIC_SEQ_CST);
+        // notify demos; the completion must stay an eventfd, as the scheduler waits in epoll
+        if (write(fd_completed, &buf, sizeof(buf)) == -1) {
+            __atomic_store_n(&yield_page->waiting, 0, __ATOMIC_SEQ_CST);
+            return -1;
+        }
+        int s = wait_for_continue(seq);
+        __atomic_store_n(&yield_page->waiting, 0, __ATOMIC_SEQ_CST);
+        if (s != 0) return s;
+    } else {
+        // notify demos
+        if (write(fd_completed, &buf, sizeof(buf)) == -1) {
+            return -1;
+        }
+
+        // block until become readable
+        if (read(fd_new_period, &buf, sizeof(buf)) == -1) {
+            return -1;
+        }
     }
 
     LOG_DEBUG("Process resumed");
@@ -109,3 +180,32 @@ int demos_initialization_completed()
     LOG_DEBUG("Initialization completed");
     return demos_completed();
 }
+
+int demos_get_sched_info(struct demos_sched_info *info)
+{
+    if (!demos_init_ran) {
+        LOG_DEBUG("Calling `demos_init()` from `demos_get_sched_info()`");
+        int s = demos_init();
+        if (s != 0) return s;
+    }
+
+    if (!info_page) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    // seqlock read side, retry if the scheduler updated the page while we were reading it
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&info_page->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        info->budget_deadline_ns =
+          __atomic_load_n(&info_page->budget_deadline_ns, __ATOMIC_RELAXED);
+        info->window_end_ns = __atomic_load_n(&info_page->window_end_ns, __ATOMIC_RELAXED);
+        info->major_frame = __atomic_load_n(&info_page->major_frame, __ATOMIC_RELAXED);
+        info->window_index = __atomic_load_n(&info_page->window_index, __ATOMIC_RELAXED);
+        info->overruns = __atomic_load_n(&info_page->overruns, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&info_page->seq, __ATOMIC_RELAXED));
+    return 0;
+}
@@ -1,6 +1,8 @@
 #ifndef DEMOSSCH_H
 #define DEMOSSCH_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -36,6 +38,40 @@ int demos_initialization_completed(void);
  */
 int demos_completed(void);
 
+/** Scheduling state of the calling process, see `demos_get_sched_info()`. */
+struct demos_sched_info
+{
+    /**
+     * End of the budget of the current run, as CLOCK_MONOTONIC time in nanoseconds.
+     * Zero if the process is not currently scheduled.
+     */
+    uint64_t budget_deadline_ns;
+    /** End of the current window, as CLOCK_MONOTONIC time in nanoseconds. */
+    uint64_t window_end_ns;
+    /** Number of major frames completed since the scheduler started. */
+    uint64_t major_frame;
+    /** Zero-based index of the current window in the major frame. */
+    uint32_t window_index;
+    /**
+     * Number of runs in an SC partition that ended before the process called
+     * `demos_completed()` (the budget or the window ended). A process can compare it
+     * with the value from its previous run to find out that it was preempted mid-frame.
+     */
+    uint64_t overruns;
+};
+
+/**
+ * Reads the current scheduling state of the process from a page shared with
+ * the scheduler, without any syscall (after the first call).
+ *
+ * The process may be preempted at any time, so both deadlines can already be in the past.
+ * Note that the budget deadline may be later than the window end.
+ *
+ * @return 0 if successful, -1 otherwise and `errno` is set appropriately
+ *  (`ENOTSUP` if the scheduler does not provide the page)
+ */
+int demos_get_sched_info(struct demos_sched_info *info);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,6 +1,7 @@
 #include "cgroup.hpp"
 #include "log.hpp"
 #include <fstream>
+#include <string_view>
 #include <lib/assert.hpp>
 
 #include "lib/check_lib.hpp"
@@ -70,6 +71,38 @@ void Cgroup::kill_all()
     }
 }
 
+void Cgroup::signal_all(int signal)
+{
+    ifstream procs(path + "/cgroup.procs");
+    pid_t pid;
+    while (procs >> pid) {
+        // ESRCH = the process exited since `cgroup.procs` was read
+        if (kill(pid, signal) == -1 && errno != ESRCH) {
+            logger_process->warn(
+              "Cannot send signal {} to process '{}': {}", signal, pid, strerror(errno));
+        }
+    }
+}
+
+/** Set when the kernel does not support `cgroup.kill`, to avoid retrying for each cgroup. */
+static bool cgroup_kill_unsupported = false;
+
+bool Cgroup::kill_tree()
+{
+    if (cgroup_kill_unsupported) return false;
+    int fd = open((path + "/cgroup.kill").c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd == -1 && errno == ENOENT) {
+        logger_process->debug("cgroup.kill is not supported, killing processes one by one");
+        cgroup_kill_unsupported = true;
+        return false;
+    }
+    CHECK_MSG(fd, "open " + path + "/cgroup.kill");
+    logger_process->debug("Killing all processes in '{}'", path);
+    CHECK(write(fd, "1", 1));
+    close(fd);
+    return true;
+}
+
 std::string Cgroup::get_path() const
 {
     return path;
@@ -106,6 +139,7 @@ void CgroupFreezer::unfreeze() // NOLINT(readability-make-member-function-const)
 CgroupCpuset::CgroupCpuset(const string &parent_path, const string &name)
     : Cgroup(parent_path, name)
     , fd_cpus{ CHECK(open((path + "/cpuset.cpus").c_str(), O_RDWR | O_NONBLOCK)) }
+    , fd_procs{ CHECK(open((path + "/cgroup.procs").c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC)) }
 {}
 
 CgroupCpuset::CgroupCpuset(const Cgroup &parent, const std::string &name)
@@ -115,6 +149,14 @@ CgroupCpuset::CgroupCpuset(const Cgroup &parent, const std::string &name)
 CgroupCpuset::~CgroupCpuset()
 {
     close(fd_cpus);
+    close(fd_procs);
+}
+
+void CgroupCpuset::add_process(pid_t pid) // NOLINT(readability-make-member-function-const)
+{
+    logger_process->trace("Adding process '{}' to cgroup '{}'", pid, path);
+    string s = to_string(pid);
+    CHECK(write(fd_procs, s.c_str(), s.size()));
 }
 
 void CgroupCpuset::set_cpus(cpu_set cpus)
@@ -144,23 +186,36 @@ CgroupUnified::~CgroupUnified()
 }
 
 bool CgroupUnified::read_populated_status() const
+{
+    return read_events().populated;
+}
+
+CgroupUnified::Events CgroupUnified::read_events() const
 {
     char buf[100];
     ssize_t size = CHECK(pread(fd_events, buf, sizeof(buf) - 1, 0));
-    return (std::string(buf, static_cast<unsigned long>(size)).find("populated 1") !=
-            std::string::npos);
+    std::string_view events(buf, static_cast<unsigned long>(size));
+    // `frozen` is only present on kernels with the cgroup v2 freezer
+    return { events.find("populated 1") != std::string_view::npos,
+             events.find("frozen 1") != std::string_view::npos };
 }
 
 /////////////////////
 CgroupEvents::CgroupEvents(ev::loop_ref loop,
                            const string &parent_path,
                            const string &name,
-                           const std::function<void(bool)> &populated_cb)
+                           const std::function<void(bool)> &populated_cb,
+                           const FrozenCb &frozen_cb)
     : CgroupUnified(parent_path, name)
     , events_w(loop)
     , populated_cb(populated_cb)
+    , frozen_cb(frozen_cb)
 {
     ASSERT(populated_cb);
+    if (frozen_cb) {
+        fd_freeze = CHECK(open((path + "/cgroup.freeze").c_str(), O_RDWR | O_NONBLOCK));
+        fd_dir = CHECK(open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+    }
     events_w.set<CgroupEvents, &CgroupEvents::event_cb>(this);
     events_w.start(this->fd_events, ev::EXCEPTION);
 }
@@ -168,16 +223,41 @@ CgroupEvents::CgroupEvents(ev::loop_ref loop,
 CgroupEvents::CgroupEvents(ev::loop_ref loop,
                            const Cgroup &parent,
                            const string &name,
-                           const std::function<void(bool)> &populated_cb)
-    : CgroupEvents(loop, parent.get_path(), name, populated_cb)
+                           const std::function<void(bool)> &populated_cb,
+                           const FrozenCb &frozen_cb)
+    : CgroupEvents(loop, parent.get_path(), name, populated_cb, frozen_cb)
 {}
 
 CgroupEvents::~CgroupEvents()
 {
     events_w.stop();
+    if (fd_freeze != -1) close(fd_freeze);
+    if (fd_dir != -1) close(fd_dir);
+}
+
+void CgroupEvents::freeze()
+{
+    ASSERT(fd_freeze != -1);
+    CHECK(write(fd_freeze, "1", 1));
+    // the write only requests the freeze, the kernel confirms it asynchronously
+    //  by setting `frozen 1` in cgroup.events (see `event_cb`)
+    freeze_start = std::chrono::steady_clock::now();
+    freeze_pending = true;
+}
+
+void CgroupEvents::unfreeze()
+{
+    ASSERT(fd_freeze != -1);
+    CHECK(write(fd_freeze, "0", 1));
+    freeze_pending = false;
 }
 
 void CgroupEvents::event_cb()
 {
-    populated_cb(read_populated_status());
+    auto events = read_events();
+    if (freeze_pending && events.frozen) {
+        freeze_pending = false;
+        frozen_cb(std::chrono::steady_clock::now() - freeze_start);
+    }
+    populated_cb(events.populated);
 }
@@ -3,6 +3,7 @@
 #include "lib/cpu_set.hpp"
 #include <bitset>
 #include <cerrno>
+#include <chrono>
 #include <csignal>
 #include <err.h>
 #include <ev++.h>
@@ -29,7 +30,19 @@ public:
     ~Cgroup();
 
     void add_process(pid_t pid);
+    /** Sends SIGKILL to all processes listed in `cgroup.procs` (not to child cgroups). */
     void kill_all();
+    /**
+     * Sends `signal` to all processes listed in `cgroup.procs` (not to child cgroups).
+     * Processes that exit meanwhile are ignored, other failures are only logged.
+     */
+    void signal_all(int signal);
+    /**
+     * Kills all processes in this cgroup and all its descendants with a single write
+     * to `cgroup.kill` (cgroup v2, Linux 5.14+). Unlike `kill_all()`, processes that fork
+     * concurrently cannot escape. Returns false if `cgroup.kill` is not supported.
+     */
+    bool kill_tree();
 
     // delete copy constructor
     Cgroup(const Cgroup &) = delete;
@@ -46,6 +59,7 @@ protected:
     std::string path;
 };
 
+/** Freezer from the cgroup v1 `freezer` hierarchy. */
 class CgroupFreezer : public Cgroup
 {
 public:
@@ -69,9 +83,12 @@ public:
 
     void set_cpus(cpu_set cpus);
     const cpu_set& get_cpus() const { return current_cpus; }
+    /** Same as `Cgroup::add_process`, but uses a pre-opened `cgroup.procs`. */
+    void add_process(pid_t pid);
 
 private:
     int fd_cpus;
+    int fd_procs;
     cpu_set current_cpus = { 0 };
 };
 
@@ -82,7 +99,14 @@ public:
     CgroupUnified(const Cgroup &parent, const std::string &name);
     ~CgroupUnified();
 
+    struct Events
+    {
+        bool populated;
+        bool frozen;
+    };
+
     [[nodiscard]] bool read_populated_status() const;
+    [[nodiscard]] Events read_events() const;
 
 protected:
     int fd_events;
@@ -92,24 +116,49 @@ protected:
  * Monitors cgroup.events (Cgroups v2) for changes and on every change
  * calls populated_cb callback with information whether the cgroup is
  * populated or not.
+ *
+ * If frozen_cb is passed, the cgroup can also be frozen through the
+ * cgroup v2 freezer (`cgroup.freeze`, Linux 5.2+). After each `freeze()`,
+ * frozen_cb is called once the kernel reports `frozen 1` in cgroup.events,
+ * with the time it took for the freeze to take effect.
  */
 class CgroupEvents : public CgroupUnified
 {
 public:
+    using FrozenCb = std::function<void(std::chrono::nanoseconds)>;
+
     CgroupEvents(ev::loop_ref loop,
                  const std::string &parent_path,
                  const std::string &name,
-                 const std::function<void(bool)> &populated_cb);
+                 const std::function<void(bool)> &populated_cb,
+                 const FrozenCb &frozen_cb = nullptr);
 
     CgroupEvents(ev::loop_ref loop,
                  const Cgroup &parent,
                  const std::string &name,
-                 const std::function<void(bool)> &populated_cb);
+                 const std::function<void(bool)> &populated_cb,
+                 const FrozenCb &frozen_cb = nullptr);
 
     ~CgroupEvents();
 
+    void freeze();
+    void unfreeze();
+
+    /**
+     * Returns a file descriptor of the cgroup directory, which can be used to spawn
+     * processes directly into the cgroup (`CLONE_INTO_CGROUP`), or -1 if the cgroup v2
+     * freezer is not used.
+     */
+    [[nodiscard]] int get_dir_fd() const { return fd_dir; }
+
 private:
     ev::io events_w;
     std::function<void(bool)> populated_cb;
+    FrozenCb frozen_cb;
+    int fd_freeze = -1;
+    int fd_dir = -1;
+    /** Set by `freeze()`, cleared when the kernel confirms the cgroup is frozen. */
+    bool freeze_pending = false;
+    std::chrono::steady_clock::time_point freeze_start{};
     void event_cb();
 };
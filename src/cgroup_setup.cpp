@@ -2,6 +2,8 @@
 
 #include "lib/assert.hpp"
 #include "lib/check_lib.hpp"
+#include "log.hpp"
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 
@@ -74,7 +76,6 @@ static void handle_cgroup_exc(stringstream &commands,
 
     for (auto [path, type] : {
            make_pair(&unified_path, "unified"),
-           make_pair(&freezer_path, "freezer"),
            make_pair(&cpuset_path, "cpuset"),
          }) {
         if (path->empty()) throw runtime_error(string(type) + " cgroup not found");
@@ -100,8 +101,12 @@ static void handle_cgroup_exc(stringstream &commands,
     // TODO: Verify that commands added to the commands variable still
     //  make sense (after changing a bit cgroup structure).
 
+    bool v2_freezer = false;
     try {
         unified = Cgroup(unified_path, true);
+        // `cgroup.freeze` is only present in non-root cgroups on Linux 5.2+
+        v2_freezer = !getenv("DEMOS_CGROUP_V1_FREEZER") &&
+                     std::filesystem::exists(unified_path + "/cgroup.freeze");
     } catch (system_error &e) {
         handle_cgroup_exc(commands, mount_cmds, e, unified_path);
     }
@@ -113,15 +118,21 @@ static void handle_cgroup_exc(stringstream &commands,
         commands << "sudo echo " << getppid() << " > " << unified_path + "/cgroup.procs" << endl;
     }
 
-    try {
-        freezer = Cgroup(freezer_path, true);
-    } catch (system_error &e) {
-        handle_cgroup_exc(commands, mount_cmds, e, freezer_path);
-    }
-    try {
-        freezer.add_process(child.pid);
-    } catch (system_error &) {
-        commands << "sudo chown -R " << getuid() << " " << freezer_path << endl;
+    if (v2_freezer) {
+        logger->debug("Using cgroup v2 freezer");
+    } else {
+        if (freezer_path.empty()) throw runtime_error("freezer cgroup not found");
+        logger->debug("Using cgroup v1 freezer");
+        try {
+            freezer = Cgroup(freezer_path, true);
+        } catch (system_error &e) {
+            handle_cgroup_exc(commands, mount_cmds, e, freezer_path);
+        }
+        try {
+            freezer.add_process(child.pid);
+        } catch (system_error &) {
+            commands << "sudo chown -R " << getuid() << " " << freezer_path << endl;
+        }
     }
 
     try {
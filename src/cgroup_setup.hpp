@@ -3,6 +3,11 @@
 #include "cgroup.hpp"
 
 namespace cgroup_setup {
+/**
+ * Creates the top-level DEmOS cgroups. If the unified hierarchy supports
+ * the cgroup v2 freezer (`cgroup.freeze`), `freezer` is left empty
+ * and the v1 freezer hierarchy is not used at all.
+ */
 [[nodiscard]] bool create_toplevel_cgroups(Cgroup &unified,
                                            Cgroup &freezer,
                                            Cgroup &cpuset,
@@ -1,7 +1,10 @@
 #include "config.hpp"
 #include "log.hpp"
 #include "power_policy/_power_policy.hpp"
+#include "trace.hpp"
+#include <cctype>
 #include <cmath>
+#include <csignal>
 #include <exception>
 #include <lib/assert.hpp>
 
@@ -47,6 +50,115 @@ void Config::load_from_string(const string &config_str)
     }
 }
 
+/** `true` enables adaptive budget with the default settings. */
+static Node normalize_adaptive_budget(const Node &adaptive)
+{
+    Node norm;
+    if (adaptive.IsScalar()) {
+        if (!adaptive.as<bool>()) return norm;
+    } else {
+        for (const auto &key : adaptive) {
+            auto k = key.first.as<string>();
+            if (k == "percentile" || k == "margin") {
+                norm[k] = adaptive[k].as<double>();
+            } else if (k == "min_budget") {
+                norm[k] = adaptive[k].as<int>();
+            } else {
+                throw runtime_error("Unexpected config key in adaptive_budget: " + k);
+            }
+        }
+    }
+    if (!norm["percentile"]) norm["percentile"] = 95.0;
+    if (!norm["margin"]) norm["margin"] = 10.0;
+    if (!norm["min_budget"]) norm["min_budget"] = 1;
+
+    double percentile = norm["percentile"].as<double>();
+    if (!(percentile > 0 && percentile < 100)) {
+        throw runtime_error("'adaptive_budget.percentile' must be between 0 and 100");
+    }
+    if (!(norm["margin"].as<double>() >= 0)) {
+        throw runtime_error("'adaptive_budget.margin' must be non-negative");
+    }
+    if (norm["min_budget"].as<int>() <= 0) {
+        throw runtime_error("'adaptive_budget.min_budget' must be positive");
+    }
+    return norm;
+}
+
+/** Signals accepted by the `signal` overrun policy, by their names without the `SIG` prefix. */
+static const pair<const char *, int> overrun_signals[] = {
+    { "HUP", SIGHUP },   { "INT", SIGINT },   { "QUIT", SIGQUIT }, { "ABRT", SIGABRT },
+    { "KILL", SIGKILL }, { "USR1", SIGUSR1 }, { "USR2", SIGUSR2 }, { "ALRM", SIGALRM },
+    { "TERM", SIGTERM }, { "XCPU", SIGXCPU },
+};
+
+/** Accepts a signal number, or a name with or without the `SIG` prefix (e.g. `SIGUSR1`). */
+static int parse_signal(const Node &signal)
+{
+    auto name = signal.as<string>();
+    if (!name.empty() && isdigit(name[0])) {
+        int num = signal.as<int>();
+        if (num <= 0 || num > SIGRTMAX) {
+            throw runtime_error("Invalid signal number in on_overrun: " + name);
+        }
+        return num;
+    }
+    if (name.rfind("SIG", 0) == 0) name = name.substr(3);
+    for (const auto &[sig_name, num] : overrun_signals) {
+        if (name == sig_name) return num;
+    }
+    throw runtime_error("Unknown signal in on_overrun: " + signal.as<string>());
+}
+
+/**
+ * Normalizes the overrun policy, given either as the action name or as a mapping
+ * with the `action` key; `continue` (the default) returns a null node.
+ */
+static Node normalize_overrun_policy(const Node &policy)
+{
+    Node norm;
+    if (policy.IsScalar()) {
+        norm["action"] = policy.as<string>();
+    } else {
+        for (const auto &key : policy) {
+            auto k = key.first.as<string>();
+            if (k == "action") {
+                norm[k] = policy[k].as<string>();
+            } else if (k == "signal") {
+                // only validated here, the signal is kept as the user wrote it
+                parse_signal(policy[k]);
+                norm[k] = policy[k].as<string>();
+            } else if (k == "restart_after") {
+                norm[k] = policy[k].as<int>();
+            } else {
+                throw runtime_error("Unexpected config key in on_overrun: " + k);
+            }
+        }
+    }
+    if (!norm["action"]) throw runtime_error("Missing 'action' in on_overrun");
+
+    auto action = norm["action"].as<string>();
+    if (action != "continue" && action != "skip" && action != "signal" && action != "restart") {
+        throw runtime_error("Unknown on_overrun action '" + action +
+                            "', expected continue, skip, signal or restart");
+    }
+    if (norm["signal"] && action != "signal") {
+        throw runtime_error("'on_overrun.signal' is only valid with the 'signal' action");
+    }
+    if (norm["restart_after"] && action != "restart") {
+        throw runtime_error("'on_overrun.restart_after' is only valid with the 'restart' action");
+    }
+    if (action == "continue") return {};
+    if (action == "signal" && !norm["signal"]) norm["signal"] = "SIGXCPU";
+    if (action == "restart") {
+        if (!norm["restart_after"]) norm["restart_after"] = 1;
+        if (norm["restart_after"].as<int>() <= 0) {
+            throw runtime_error("'on_overrun.restart_after' must be positive");
+        }
+    }
+    return norm;
+}
+
 static Node normalize_process(const Node &proc, float default_budget)
 {
     Node norm_proc;
@@ -68,8 +180,28 @@ static Node normalize_process(const Node &proc, float default_budget)
                 // if true, we wait until the process completes initialization
                 //  before freezing it and starting normal scheduling
                 norm_proc[k] = proc[k].as<bool>();
+            } else if (k == "futex_yield") {
+                // if true, continuation after `demos_completed()` is signalled
+                //  through a shared futex word instead of an eventfd
+                norm_proc[k] = proc[k].as<bool>();
             } else if (k == "frequency") {
                 norm_proc[k] = proc[k].as<double>();
+            } else if (k == "adaptive_budget") {
+                Node adaptive = normalize_adaptive_budget(proc[k]);
+                if (!adaptive.IsNull()) norm_proc[k] = adaptive;
+            } else if (k == "weight") {
+                // share of the partition time in BE partitions with stride scheduling
+                int weight = proc[k].as<int>();
+                if (weight < 1 || weight > static_cast<int>(Process::max_weight)) {
+                    throw runtime_error("Process weight must be between 1 and " +
+                                        to_string(Process::max_weight) + ", got '" +
+                                        to_string(weight) + "'");
+                }
+                norm_proc[k] = weight;
+            } else if (k == "on_overrun") {
+                // what happens when the process does not complete within its SC budget
+                Node policy = normalize_overrun_policy(proc[k]);
+                if (!policy.IsNull()) norm_proc[k] = policy;
             } else {
                 throw runtime_error("Unexpected config key: " + k);
             }
@@ -111,6 +243,15 @@ static Node normalize_process(const Node &proc, float default_budget)
         norm_proc["init"] = false;
     }
 
+    if (norm_proc["adaptive_budget"]) {
+        if (norm_proc["jitter"].as<int>() != 0) {
+            throw runtime_error("'adaptive_budget' cannot be combined with 'jitter'");
+        }
+        if (norm_proc["adaptive_budget"]["min_budget"].as<int>() > budget) {
+            throw runtime_error("'adaptive_budget.min_budget' must not exceed the budget");
+        }
+    }
+
     return norm_proc;
 }
 
@@ -143,7 +284,16 @@ Node Config::normalize_partition(
                 norm_part[k] = part[k].as<string>();
             else if (k == "processes")
                 processes = normalize_processes(part[k], total_budget);
-            else if (k == "cmd" || k == "budget" || k == "jitter" || k == "init" ||
+            else if (k == "be_scheduling") {
+                // how the next process is selected when the partition runs as BE
+                auto scheduling = part[k].as<string>();
+                if (scheduling != "round_robin" && scheduling != "stride") {
+                    throw runtime_error("Unknown be_scheduling '" + scheduling +
+                                        "', expected round_robin or stride");
+                }
+                norm_part[k] = scheduling;
+            } else if (k == "cmd" || k == "budget" || k == "jitter" || k == "init" ||
+                     k == "futex_yield" || k == "adaptive_budget" || k == "on_overrun" ||
                      k == "_a53_freq" || k == "_a72_freq")
                 ;
             else
@@ -161,7 +311,15 @@ Node Config::normalize_partition(
         if (processes.IsNull()) {
             Node process;
             for (const string &key :
-                 { "cmd", "budget", "jitter", "init", "_a53_freq", "_a72_freq" }) {
+                 { "cmd",
+                   "budget",
+                   "jitter",
+                   "init",
+                   "futex_yield",
+                   "adaptive_budget",
+                   "on_overrun",
+                   "_a53_freq",
+                   "_a72_freq" }) {
                 if (part[key]) {
                     process[key] = part[key];
                 }
@@ -211,6 +369,8 @@ Node Config::normalize_slice(const Node &slice,
             norm_slice[k] = slice[k].as<string>();
         else if (k == "frequency")
             norm_slice[k] = slice[k].as<double>();
+        else if (k == "parallel_be")
+            norm_slice[k] = slice[k].as<bool>();
         else if (k == "sc_partition")
             // if process budget is not set, `0.6 * window length` is used as a default for SC
             //  partition; otherwise, SC partition would use up the whole budget, not leaving any
@@ -291,6 +451,24 @@ Node Config::normalize_window(const Node &win,  // in: window to normalize
     return norm_win;
 }
 
+static const string default_mode_name = "default";
+
+/**
+ * Calls `f(mode_name, mode_windows)` for each mode defined in the `windows` node.
+ * If `windows` is a sequence, there is a single mode named "default".
+ */
+template<typename F>
+static void for_each_mode(const Node &windows, F f)
+{
+    if (windows.IsMap()) {
+        for (const auto &mode : windows) {
+            f(mode.first.as<string>(), mode.second);
+        }
+    } else {
+        f(default_mode_name, windows);
+    }
+}
+
 /**
  * Validates that all referenced partitions exist and slices don't have overlapping cpusets.
  *
@@ -300,10 +478,18 @@ Node Config::normalize_window(const Node &win,  // in: window to normalize
  * format is probably currently too much work for too little benefit.
  */
 void Config::validate_config()
+{
+    bool has_modes = config["windows"].IsMap();
+    for_each_mode(config["windows"], [&](const string &mode_name, const Node &windows) {
+        validate_windows(windows, has_modes ? " of mode '" + mode_name + "'" : "");
+    });
+}
+
+void Config::validate_windows(const Node &windows, const string &mode_desc)
 {
     // check if all references to partition names are valid
     int window_i = -1;
-    for (const auto &win : config["windows"]) {
+    for (const auto &win : windows) {
         window_i++;
         int slice_i = -1;
         for (const auto &slice : win["slices"]) {
@@ -318,8 +504,8 @@ void Config::validate_config()
                     }
                 }
                 throw runtime_error("Reference to unknown partition '" + searched_name +
-                                    "' in window #" + to_string(window_i) + ", slice #" +
-                                    to_string(slice_i));
+                                    "' in window #" + to_string(window_i) + mode_desc +
+                                    ", slice #" + to_string(slice_i));
             found:;
             }
         }
@@ -327,7 +513,7 @@ void Config::validate_config()
 
     // check if slices in each window have any CPU set overlaps
     window_i = -1;
-    for (const auto &win : config["windows"]) {
+    for (const auto &win : windows) {
         window_i++;
         cpu_set acc{};
         for (const auto &slice : win["slices"]) {
@@ -336,7 +522,7 @@ void Config::validate_config()
             // if a slice has `cpu: all`, there must not be any other slices in the window
             // else, check for overlap with previous slices
             if ((cpu_str == "all" && win["slices"].size() > 1) || acc & slice_cpu) {
-                throw runtime_error("Slices in window #" + to_string(window_i) +
+                throw runtime_error("Slices in window #" + to_string(window_i) + mode_desc +
                                     " have overlapping CPU sets");
             }
             acc |= slice_cpu;
@@ -371,6 +557,17 @@ void Config::normalize()
                             "'set_cwd' must be set to 'false'");
     }
 
+    auto reference_frequency = config["reference_frequency"]
+                                 ? optional(config["reference_frequency"].as<double>())
+                                 : nullopt;
+    if (reference_frequency && *reference_frequency <= 0) {
+        throw runtime_error("'reference_frequency' must be positive");
+    }
+    config.remove("reference_frequency");
+
+    bool reclaim_slack = config["reclaim_slack"] ? config["reclaim_slack"].as<bool>() : false;
+    config.remove("reclaim_slack");
+
     string demos_cpu = config["demos_cpu"] ? config["demos_cpu"].as<string>() : "all";
     // validate that the cpulist is in correct format
     parse_cpu_set(demos_cpu, 0);
@@ -382,9 +579,27 @@ void Config::normalize()
     }
     config.remove("partitions");
 
+    // `windows` is either a list of windows, or a map from mode name to a list of windows
     Node norm_windows;
-    for (const auto &win : config["windows"]) {
-        norm_windows.push_back(normalize_window(win, norm_partitions));
+    if (config["windows"].IsMap()) {
+        if (config["windows"].size() == 0) {
+            throw runtime_error("'windows' must define at least one mode");
+        }
+        for (const auto &mode : config["windows"]) {
+            auto mode_name = mode.first.as<string>();
+            if (!mode.second.IsSequence()) {
+                throw runtime_error("Windows of mode '" + mode_name + "' must be a sequence");
+            }
+            Node norm_mode_windows;
+            for (const auto &win : mode.second) {
+                norm_mode_windows.push_back(normalize_window(win, norm_partitions));
+            }
+            norm_windows[mode_name] = norm_mode_windows;
+        }
+    } else {
+        for (const auto &win : config["windows"]) {
+            norm_windows.push_back(normalize_window(win, norm_partitions));
+        }
     }
     config.remove("windows");
 
@@ -395,6 +610,8 @@ void Config::normalize()
     Node norm_config;
     norm_config["set_cwd"] = set_cwd;
     norm_config["demos_cpu"] = demos_cpu;
+    if (reference_frequency) norm_config["reference_frequency"] = *reference_frequency;
+    if (reclaim_slack) norm_config["reclaim_slack"] = true;
     norm_config["partitions"] = norm_partitions;
     norm_config["windows"] = norm_windows;
 
@@ -412,12 +629,77 @@ static Partition *find_partition(const string &name, Partitions &partitions)
 }
 
 // TODO: Move this out of Config to new DemosSched class
+void Config::check_schedulable() const
+{
+    bool has_empty_mode = false;
+    for_each_mode(config["windows"], [&](const string &, const Node &windows) {
+        if (windows.size() == 0) has_empty_mode = true;
+    });
+    if (config["partitions"].size() == 0 || config["windows"].size() == 0 || has_empty_mode) {
+        throw runtime_error("Need at least one partition in one window");
+    }
+}
+
 void Config::create_scheduler_objects(const CgroupConfig &c,
+                                      const cpu_set &allowed_cpus,
                                       cpu_set &demos_cpuset,
-                                      Windows &windows,
+                                      Modes &modes,
                                       Partitions &partitions)
 {
+    Partitions removed; // stays empty, as there are no partitions to replace
+    update_scheduler_objects(c, allowed_cpus, modes, partitions, removed);
+    demos_cpuset = parse_cpu_set(config["demos_cpu"], allowed_cpus);
+}
+
+void Config::update_scheduler_objects(const CgroupConfig &c,
+                                      const cpu_set &allowed_cpus,
+                                      Modes &modes,
+                                      Partitions &partitions,
+                                      Partitions &removed_partitions)
+{
+    check_schedulable();
+    auto ref_freq = config["reference_frequency"]
+                      ? std::optional(CpuFrequencyHz{ static_cast<uint64_t>(
+                          1000 * 1000 * config["reference_frequency"].as<double>()) })
+                      : std::nullopt;
+    if (ref_freq && !c.power_policy.supports_budget_scaling()) {
+        logger->warn("Reference frequency specified in the configuration, but the power policy "
+                     "does not manage CPU frequencies; budgets are not scaled.");
+        ref_freq = nullopt;
+    }
+    c.power_policy.set_reference_frequency(ref_freq);
     bool ppf_warned = false;
+    build_scheduler_objects(c, allowed_cpus, "", modes, partitions, removed_partitions, ppf_warned);
+    c.power_policy.validate_modes(modes);
+}
+
+void Config::check_scheduler_objects(const CgroupConfig &c, const cpu_set &allowed_cpus)
+{
+    check_schedulable();
+    const size_t subject_count = schedule_trace.subject_count();
+    try {
+        Partitions partitions, removed;
+        // declared after the partitions, as the windows refer to them
+        Modes modes;
+        bool ppf_warned = true; // warned when the configuration is applied
+        build_scheduler_objects(
+          c, allowed_cpus, "reload-check-", modes, partitions, removed, ppf_warned);
+        c.power_policy.check_modes(modes);
+    } catch (...) {
+        schedule_trace.forget_subjects(subject_count);
+        throw;
+    }
+    schedule_trace.forget_subjects(subject_count);
+}
+
+void Config::build_scheduler_objects(const CgroupConfig &c,
+                                     const cpu_set &allowed_cpus,
+                                     const string &cgroup_prefix,
+                                     Modes &modes,
+                                     Partitions &partitions,
+                                     Partitions &removed_partitions,
+                                     bool &ppf_warned)
+{
     optional<filesystem::path> process_cwd{};
     if (config["set_cwd"].as<bool>()) {
         ASSERT(config_file_path != nullopt);
@@ -429,9 +711,22 @@ void Config::create_scheduler_objects(const CgroupConfig &c,
         logger->trace("Using current working directory for all processes");
     }
 
+    // partitions in the order of the new config; existing partitions with the same name
+    //  are moved here and keep their running processes where possible
+    Partitions updated;
     for (const auto &ypart : config["partitions"]) {
-        partitions.emplace_back(
-          c.freezer_cg, c.cpuset_cg, c.unified_cg, ypart["name"].as<string>());
+        auto name = ypart["name"].as<string>();
+        auto existing = find_if(partitions.begin(), partitions.end(), [&](Partition &p) {
+            return p.get_name() == name;
+        });
+        if (existing != partitions.end()) {
+            updated.splice(updated.end(), partitions, existing);
+        } else {
+            updated.emplace_back(c.freezer_cg, c.cpuset_cg, c.unified_cg, name, cgroup_prefix);
+        }
+        Partition &part = updated.back();
+        part.set_stride_scheduling(ypart["be_scheduling"].as<string>("round_robin") == "stride");
+        part.begin_update();
         for (const auto &yprocess : ypart["processes"]) {
             auto budget = chrono::milliseconds(yprocess["budget"].as<int>());
             auto budget_jitter = chrono::milliseconds(yprocess["jitter"].as<int>());
@@ -443,29 +738,66 @@ void Config::create_scheduler_objects(const CgroupConfig &c,
                 logger->warn("Per-processes frequency specified in the configuration, but not supported by the power policy.");
                 ppf_warned = true;
             }
-            partitions.back().add_process(c.loop,
-                                          yprocess["cmd"].as<string>(),
-                                          process_cwd,
-                                          budget,
-                                          budget_jitter,
-                                          req_freq,
-                                          yprocess["init"].as<bool>());
+            part.add_process(c.loop,
+                             yprocess["cmd"].as<string>(),
+                             process_cwd,
+                             budget,
+                             budget_jitter,
+                             req_freq,
+                             yprocess["init"].as<bool>(),
+                             yprocess["futex_yield"].as<bool>(false));
+            optional<Process::AdaptiveBudget> adaptive{};
+            if (auto yadaptive = yprocess["adaptive_budget"]) {
+                adaptive = Process::AdaptiveBudget{
+                    yadaptive["percentile"].as<double>() / 100,
+                    yadaptive["margin"].as<double>() / 100,
+                    chrono::milliseconds(yadaptive["min_budget"].as<int>()),
+                };
+            }
+            part.processes.back().set_adaptive_budget(adaptive);
+            Process::OverrunPolicy overrun_policy{};
+            if (auto yoverrun = yprocess["on_overrun"]) {
+                auto action = yoverrun["action"].as<string>();
+                if (action == "skip") {
+                    overrun_policy.action = Process::OverrunPolicy::Action::skip;
+                } else if (action == "signal") {
+                    overrun_policy.action = Process::OverrunPolicy::Action::signal;
+                    overrun_policy.signal = parse_signal(yoverrun["signal"]);
+                } else if (action == "restart") {
+                    overrun_policy.action = Process::OverrunPolicy::Action::restart;
+                    overrun_policy.restart_after = yoverrun["restart_after"].as<unsigned>();
+                }
+            }
+            part.processes.back().set_overrun_policy(overrun_policy);
+            part.processes.back().set_weight(yprocess["weight"].as<unsigned>(1));
         }
+        part.finish_update();
     }
+    // partitions not present in the new config
+    removed_partitions.splice(removed_partitions.end(), partitions);
+    partitions.splice(partitions.end(), updated);
 
     logger->trace("Initialized partitions and processes");
 
-    // Read current CPU affinity mask.
-    cpu_set allowed_cpus;
-    sched_getaffinity(0, allowed_cpus.size(), allowed_cpus.ptr());
-
-    demos_cpuset = parse_cpu_set(config["demos_cpu"], allowed_cpus);
+    for_each_mode(config["windows"], [&](const string &mode_name, const Node &ywindows) {
+        Windows &windows = modes.emplace_back(Mode{ mode_name, {} }).windows;
+        create_windows(c, ywindows, allowed_cpus, partitions, windows, ppf_warned);
+    });
+}
 
-    for (const auto &ywindow : config["windows"]) {
+void Config::create_windows(const CgroupConfig &c,
+                            const Node &ywindows,
+                            const cpu_set &allowed_cpus,
+                            Partitions &partitions,
+                            Windows &windows,
+                            bool &ppf_warned)
+{
+    for (const auto &ywindow : ywindows) {
         int length = ywindow["length"].as<int>();
 
         auto budget = chrono::milliseconds(length);
-        Window &w = windows.emplace_back(c.loop, budget, c.power_policy);
+        Window &w =
+          windows.emplace_back(budget, c.power_policy, config["reclaim_slack"].as<bool>(false));
 
         for (const auto &yslice : ywindow["slices"]) {
             Partition *sc_part_ptr = nullptr, *be_part_ptr = nullptr;
@@ -511,9 +843,8 @@ void Config::create_scheduler_objects(const CgroupConfig &c,
                 ppf_warned = true;
             }
 
-            w.add_slice(sc_part_ptr, be_part_ptr, cpus, req_freq);
+            w.add_slice(
+              sc_part_ptr, be_part_ptr, cpus, req_freq, yslice["parallel_be"].as<bool>(false));
         }
     }
-
-    c.power_policy.validate(windows);
 }
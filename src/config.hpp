@@ -25,7 +25,38 @@ public:
     void load_from_string(const std::string &config_str);
 
     void normalize();
-    void create_scheduler_objects(const CgroupConfig &c, cpu_set &demos_cpuset, Windows &windows, Partitions &partitions);
+    /** Throws if there is nothing to schedule in the (normalized) config. */
+    void check_schedulable() const;
+
+    /**
+     * Creates partitions (with processes) and windows from the normalized config.
+     *
+     * @param allowed_cpus - CPU affinity of DEmOS before `demos_cpu` is applied
+     * @param demos_cpuset - out: CPUs to run DEmOS on
+     */
+    void create_scheduler_objects(const CgroupConfig &c,
+                                  const cpu_set &allowed_cpus,
+                                  cpu_set &demos_cpuset,
+                                  Modes &modes,
+                                  Partitions &partitions);
+    /**
+     * Like `create_scheduler_objects`, but reuses existing `partitions` with the same name,
+     * and running processes with an unchanged definition (see `Partition::begin_update`).
+     * Partitions not present in the config are moved to `removed_partitions`;
+     * new processes are not spawned.
+     */
+    void update_scheduler_objects(const CgroupConfig &c,
+                                  const cpu_set &allowed_cpus,
+                                  Modes &modes,
+                                  Partitions &partitions,
+                                  Partitions &removed_partitions);
+    /**
+     * Builds the scheduler objects of the (normalized) config from scratch, next to the current
+     * ones, and checks that the power policy can run them (see `PowerPolicy::check_modes`).
+     * Throws on the errors `update_scheduler_objects` would report, without changing
+     * the current objects or the power policy. Used to check a reloaded configuration.
+     */
+    void check_scheduler_objects(const CgroupConfig &c, const cpu_set &allowed_cpus);
 
     const YAML::Node &get() const { return config; }
 
@@ -36,6 +67,24 @@ private:
     int anonymous_partition_counter = 0;
 
     void validate_config();
+    void validate_windows(const YAML::Node &windows, const std::string &mode_desc);
+    /**
+     * Creates or updates the partitions and creates the windows, see `update_scheduler_objects`.
+     * `cgroup_prefix` is passed to new partitions (see `Partition::Partition`).
+     */
+    void build_scheduler_objects(const CgroupConfig &c,
+                                 const cpu_set &allowed_cpus,
+                                 const std::string &cgroup_prefix,
+                                 Modes &modes,
+                                 Partitions &partitions,
+                                 Partitions &removed_partitions,
+                                 bool &ppf_warned);
+    void create_windows(const CgroupConfig &c,
+                        const YAML::Node &ywindows,
+                        const cpu_set &allowed_cpus,
+                        Partitions &partitions,
+                        Windows &windows,
+                        bool &ppf_warned);
 
     YAML::Node normalize_window(const YAML::Node &win, YAML::Node &partitions);
     YAML::Node normalize_partition(const YAML::Node &part, float total_budget);
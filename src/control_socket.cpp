@@ -0,0 +1,104 @@
+#include "control_socket.hpp"
+#include "lib/check_lib.hpp"
+#include "log.hpp"
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+ControlSocket::ControlSocket(ev::loop_ref loop, std::filesystem::path path_, Handler handler)
+    : loop(loop)
+    , path(std::move(path_))
+    , handler(std::move(handler))
+    , fd(CHECK(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)))
+    , accept_w(loop)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.string().size() >= sizeof(addr.sun_path)) {
+        close(fd);
+        throw std::runtime_error("Control socket path is too long: " + path.string());
+    }
+    strcpy(addr.sun_path, path.c_str());
+    // remove a stale socket left behind by a crashed instance, but never anything else
+    struct stat st = {};
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            close(fd);
+            throw std::runtime_error("Control socket path '" + path.string() +
+                                     "' exists and is not a socket");
+        }
+        unlink(path.c_str());
+    }
+    CHECK_MSG(bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)),
+              "Failed to bind the control socket '" + path.string() + "'");
+    CHECK(listen(fd, 4));
+
+    accept_w.set<ControlSocket, &ControlSocket::accept_cb>(this);
+    accept_w.priority = EV_MINPRI;
+    accept_w.start(fd, ev::READ);
+    logger->debug("Listening for control commands on '{}'", path.string());
+}
+
+ControlSocket::~ControlSocket()
+{
+    while (!connections.empty()) {
+        close_connection(connections.begin());
+    }
+    accept_w.stop();
+    close(fd);
+    unlink(path.c_str());
+}
+
+void ControlSocket::accept_cb()
+{
+    int conn_fd = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (conn_fd == -1) {
+        logger->warn("Failed to accept a control connection: {}", strerror(errno));
+        return;
+    }
+    auto &conn = connections.emplace_back(loop);
+    conn.w.set<ControlSocket, &ControlSocket::read_cb>(this);
+    conn.w.priority = EV_MINPRI;
+    conn.w.start(conn_fd, ev::READ);
+}
+
+void ControlSocket::read_cb(ev::io &w, [[maybe_unused]] int revents)
+{
+    // there are only a few connections at a time, a linear search is fine
+    auto conn = connections.begin();
+    while (&conn->w != &w) conn++;
+
+    char buf[256];
+    ssize_t n = read(conn->w.fd, buf, sizeof(buf));
+    if (n == -1 && (errno == EAGAIN || errno == EINTR)) return;
+    if (n <= 0) {
+        close_connection(conn);
+        return;
+    }
+    conn->buffer.append(buf, n);
+
+    size_t end;
+    while ((end = conn->buffer.find('\n')) != std::string::npos) {
+        std::string command = conn->buffer.substr(0, end);
+        conn->buffer.erase(0, end + 1);
+        if (!command.empty() && command.back() == '\r') command.pop_back();
+        if (command.empty()) continue;
+
+        std::string reply = handler(command);
+        if (reply.empty() || reply.back() != '\n') reply += '\n';
+        // replies are short, so they fit into the socket buffer of a well-behaved client
+        if (send(conn->w.fd, reply.data(), reply.size(), MSG_NOSIGNAL) == -1) {
+            close_connection(conn);
+            return;
+        }
+    }
+}
+
+void ControlSocket::close_connection(std::list<Connection>::iterator conn)
+{
+    conn->w.stop();
+    close(conn->w.fd);
+    connections.erase(conn);
+}
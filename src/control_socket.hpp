@@ -0,0 +1,47 @@
+#pragma once
+
+#include <ev++.h>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <string>
+
+/**
+ * Unix domain socket accepting line-based text commands.
+ *
+ * Each received line is passed to the handler and the returned string is sent back
+ * as the reply. All watchers run at the lowest libev priority, so that handling
+ * a request never delays a pending scheduler timer.
+ */
+class ControlSocket
+{
+public:
+    using Handler = std::function<std::string(const std::string &command)>;
+
+    ControlSocket(ev::loop_ref loop, std::filesystem::path path, Handler handler);
+    ~ControlSocket();
+
+    ControlSocket(const ControlSocket &) = delete;
+    const ControlSocket &operator=(const ControlSocket &) = delete;
+
+private:
+    struct Connection
+    {
+        explicit Connection(ev::loop_ref loop)
+            : w(loop)
+        {}
+        ev::io w;
+        std::string buffer{};
+    };
+
+    ev::loop_ref loop;
+    const std::filesystem::path path;
+    Handler handler;
+    int fd;
+    ev::io accept_w;
+    std::list<Connection> connections{};
+
+    void accept_cb();
+    void read_cb(ev::io &w, int revents);
+    void close_connection(std::list<Connection>::iterator conn);
+};
@@ -0,0 +1,67 @@
+#include "tests/acutest.h"
+
+#include "control_socket.hpp"
+#include "log.hpp"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+static int connect_to(const string &path)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    TEST_ASSERT(connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+    return fd;
+}
+
+/** Runs the event loop until `n` bytes can be read from `fd`. */
+static string receive(ev::default_loop &loop, int fd, size_t n)
+{
+    string reply;
+    char buf[256];
+    for (int i = 0; i < 1000 && reply.size() < n; i++) {
+        loop.run(ev::NOWAIT);
+        ssize_t r = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (r > 0) reply.append(buf, r);
+        usleep(1000);
+    }
+    return reply;
+}
+
+static void test_commands()
+{
+    initialize_logger("%v", false, false);
+    ev::default_loop loop;
+    string path = "/tmp/demos-control-test-" + to_string(getpid()) + ".sock";
+    vector<string> received;
+    {
+        ControlSocket cs(loop, path, [&](const string &cmd) {
+            received.push_back(cmd);
+            return "reply " + cmd;
+        });
+
+        int fd = connect_to(path);
+        // two commands in a single write, the second one split into two writes
+        string msg = "stats\npau";
+        TEST_CHECK(write(fd, msg.data(), msg.size()) == ssize_t(msg.size()));
+        TEST_CHECK(receive(loop, fd, 12) == "reply stats\n");
+        msg = "se\r\n";
+        TEST_CHECK(write(fd, msg.data(), msg.size()) == ssize_t(msg.size()));
+        TEST_CHECK(receive(loop, fd, 12) == "reply pause\n");
+        close(fd);
+        // let the socket notice the closed connection
+        loop.run(ev::NOWAIT);
+    }
+    TEST_CHECK(received == vector<string>({ "stats", "pause" }));
+    // the socket is removed on destruction
+    TEST_CHECK(access(path.c_str(), F_OK) == -1);
+}
+
+TEST_LIST = {
+    { "commands", test_commands },
+    { nullptr, nullptr },
+};
@@ -1,13 +1,17 @@
 #pragma once
 
+#include "cpufreq_writer.hpp"
+#include "histogram.hpp"
 #include "lib/cpu_set.hpp"
 #include "lib/file_lib.hpp"
 #include "log.hpp"
+#include "trace.hpp"
 #include <fcntl.h>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <lib/assert.hpp>
+#include <atomic>
 #include <lib/check_lib.hpp>
 #include <optional>
 #include <string>
@@ -52,6 +56,22 @@ private: ///////////////////////////////////////////////////////////////////////
     string current_governor;
     // use direct `write(...)` calls over fstreams to improve performance
     int fd_freq;
+    /** Last frequency written by `write_frequency`, used to skip redundant writes. */
+    std::optional<CpuFrequencyHz> current_frequency{};
+
+    // asynchronous writes, see `CpufreqWriter`
+    friend class CpufreqWriter;
+    CpufreqWriter *writer = nullptr;
+    /** Latest requested frequency (in Hz) not yet written by the writer thread, or 0. */
+    std::atomic<uint64_t> requested_frequency{ 0 };
+    /** Time of the latest request, in `steady_clock` nanoseconds. */
+    std::atomic<int64_t> request_time_ns{ 0 };
+    /** Number of requests overwritten before the writer thread got to them. */
+    uint64_t superseded_requests = 0;
+    /** Time from the request until the write completed; only accessed by the writer thread. */
+    Log2Histogram write_latency{};
+    /** Decaying maximum of the time from a request until the write completed, in nanoseconds. */
+    std::atomic<int64_t> transition_latency_ns{ 0 };
 
 public: ////////////////////////////////////////////////////////////////////////////////////////////
     const string name;
@@ -65,6 +85,8 @@ public: ////////////////////////////////////////////////////////////////////////
     const std::optional<std::vector<CpuFrequencyHz>> available_frequencies;
     const cpu_set affected_cores;
     const bool active;
+    /** ID of this policy in the schedule trace. */
+    const uint32_t trace_id;
 
 public: ////////////////////////////////////////////////////////////////////////////////////////////
     // delete copy and (implicitly) move constructors
@@ -87,6 +109,7 @@ public: ////////////////////////////////////////////////////////////////////////
         // sometimes, the policy does not affect any cores (e.g. all controlled cores are offline);
         //  attempting to set the frequency would then cause an IO error
         , active{ affected_cores.count() > 0 }
+        , trace_id{ schedule_trace.register_subject("cpufreq/" + name) }
     {
         if (!active) {
             logger->warn("Cpufreq policy '{}' is not active, as all affected cores are offline",
@@ -149,6 +172,9 @@ public: ////////////////////////////////////////////////////////////////////////
      *  on the order of 100µs to complete; the code in window.cpp is structured so that
      *  the PowerPolicy handlers are called in moments where the resulting performance
      *  impact is minimized, but it's still not negligible
+     *
+     * If `set_writer` was called, the write is only requested here, and it is done
+     * by the `CpufreqWriter` thread.
      */
     void write_frequency(CpuFrequencyHz freq)
     {
@@ -157,12 +183,51 @@ public: ////////////////////////////////////////////////////////////////////////
         // check that freq is between min-max and is one of the supported frequencies
         // this check is only called in debug builds, because cpufreq does its own checking
         RUN_DEBUG(validate_frequency(freq));
+        // policies typically request the same frequency in consecutive windows,
+        //  and the write is slow, so skip it if nothing changes
+        if (current_frequency == freq) return;
+        current_frequency = freq;
 
         TRACE("Changing CPU frequency to '{}' for '{}'", freq, name);
-        // cpufreq uses kHz, we have Hz
-        auto freq_str = std::to_string(freq / 1000);
-        CHECK_MSG(write(fd_freq, freq_str.c_str(), freq_str.size()),
-                  "Could not set frequency for `cpufreq` policy '" + name + "'");
+        auto write_start = std::chrono::steady_clock::now();
+        if (writer) {
+            request_time_ns.store(write_start.time_since_epoch().count(),
+                                  std::memory_order_relaxed);
+            if (requested_frequency.exchange(freq, std::memory_order_release) != 0) {
+                superseded_requests++;
+            }
+            writer->notify();
+        } else {
+            write_to_file(freq);
+            record_transition_latency(std::chrono::steady_clock::now() - write_start);
+        }
+        // the recorded actual time is when the (blocking) write finished,
+        //  or when the write was requested from the writer thread
+        schedule_trace.record(TraceEvent::frequency_write, write_start, trace_id, 0, freq);
+    }
+
+    /**
+     * Offloads subsequent `write_frequency` calls to `writer_`.
+     * Pass nullptr to write synchronously again.
+     */
+    void set_writer(CpufreqWriter *writer_) { writer = writer_; }
+
+    /** Last frequency set by `write_frequency`, if any (the write may still be pending). */
+    [[nodiscard]] std::optional<CpuFrequencyHz> get_current_frequency() const
+    {
+        return current_frequency;
+    }
+
+    /**
+     * Recent maximum of the time from a `write_frequency` call until the write completed
+     * (zero before the first write). The write returns after the transition is done
+     * (at least with the `cpufreq-dt` driver used on i.MX8), so this is an upper bound
+     * of the frequency transition latency. A single outlier (e.g. the writer thread being
+     * preempted) decays away over the following writes, see `record_transition_latency`.
+     */
+    [[nodiscard]] std::chrono::nanoseconds get_transition_latency() const
+    {
+        return std::chrono::nanoseconds(transition_latency_ns.load(std::memory_order_relaxed));
     }
 
     /** Get the n-th lowest frequency available on this `cpufreq` policy. */
@@ -213,7 +278,62 @@ public: ////////////////////////////////////////////////////////////////////////
         }
     }
 
+    /**
+     * Returns the frequency closest to `freq` that can be set: clamped to min-max and rounded
+     * up to the next available frequency. If the available frequencies are not known
+     * (e.g. with `intel_pstate` in passive mode), any frequency in min-max can be set.
+     */
+    [[nodiscard]] CpuFrequencyHz snap_frequency(CpuFrequencyHz freq) const
+    {
+        if (freq <= min_frequency) return min_frequency;
+        if (freq >= max_frequency) return max_frequency;
+        if (!available_frequencies) return freq;
+        // the order of available frequencies depends on the driver
+        CpuFrequencyHz snapped = max_frequency;
+        for (CpuFrequencyHz f : *available_frequencies) {
+            if (f >= freq && f < snapped) snapped = f;
+        }
+        return snapped;
+    }
+
 private: ///////////////////////////////////////////////////////////////////////////////////////////
+    void write_to_file(CpuFrequencyHz freq)
+    {
+        // cpufreq uses kHz, we have Hz
+        auto freq_str = std::to_string(freq / 1000);
+        CHECK_MSG(write(fd_freq, freq_str.c_str(), freq_str.size()),
+                  "Could not set frequency for `cpufreq` policy '" + name + "'");
+    }
+
+    /** Called from the `CpufreqWriter` thread; writes the latest requested frequency, if any. */
+    void write_requested_frequency()
+    {
+        uint64_t freq = requested_frequency.exchange(0, std::memory_order_acquire);
+        if (freq == 0) return;
+        std::chrono::steady_clock::time_point request_time{ std::chrono::nanoseconds(
+          request_time_ns.load(std::memory_order_relaxed)) };
+        write_to_file(CpuFrequencyHz{ freq });
+        auto latency = std::chrono::steady_clock::now() - request_time;
+        write_latency.record(latency);
+        record_transition_latency(latency);
+    }
+
+    /**
+     * Called by the thread doing the writes, so a plain load and store are sufficient.
+     * A longer latency is taken immediately, a shorter one lowers the estimate by 1/16
+     * of the difference, so that it settles near the upper end of the recent latencies.
+     */
+    void record_transition_latency(std::chrono::nanoseconds latency)
+    {
+        int64_t estimate = transition_latency_ns.load(std::memory_order_relaxed);
+        if (latency.count() > estimate) {
+            estimate = latency.count();
+        } else {
+            estimate -= (estimate - latency.count()) / 16;
+        }
+        transition_latency_ns.store(estimate, std::memory_order_relaxed);
+    }
+
     string get_available_freq_str() const
     {
         if (!available_frequencies) {
@@ -0,0 +1,26 @@
+#include "tests/acutest.h"
+
+#include "cpufreq_policy.hpp"
+#include "tests/fake_sysfs.hpp"
+
+static void test_snap_frequency()
+{
+    FakeSysfs sysfs("cpufreq");
+    {
+        CpufreqPolicy p(sysfs.add_cpufreq_policy());
+        auto snap = [&](uint64_t mhz) {
+            return p.snap_frequency(CpuFrequencyHz{ mhz * 1'000'000 }) / 1'000'000;
+        };
+        TEST_CHECK(snap(100) == 600);
+        TEST_CHECK(snap(600) == 600);
+        TEST_CHECK(snap(700) == 896);
+        TEST_CHECK(snap(896) == 896);
+        TEST_CHECK(snap(1000) == 1200);
+        TEST_CHECK(snap(2000) == 1200);
+    }
+}
+
+TEST_LIST = {
+    { "snap_frequency", test_snap_frequency },
+    { nullptr, nullptr },
+};
@@ -0,0 +1,118 @@
+#include "cpufreq_writer.hpp"
+#include "cpufreq_policy.hpp"
+#include "lib/check_lib.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+CpufreqWriter::CpufreqWriter(ev::loop_ref loop,
+                             std::list<CpufreqPolicy> &policies,
+                             const cpu_set &cpus)
+    : policies(policies)
+    , efd(CHECK(eventfd(0, EFD_CLOEXEC)))
+    , error_w(loop)
+{
+    error_w.priority = EV_MINPRI;
+    error_w.set([this](ev::evfd &) { log_errors(); });
+    error_w.start();
+
+    thread = std::thread([this] { run(); });
+    set_priority();
+    int err = pthread_setaffinity_np(thread.native_handle(), cpus.size(), cpus.ptr());
+    if (err != 0) {
+        logger->warn("Failed to set the CPU affinity of the cpufreq writer thread: {}",
+                     strerror(err));
+    }
+    logger->debug("Writing CPU frequencies asynchronously from a thread on CPUs '{}'",
+                  cpus.as_list());
+}
+
+CpufreqWriter::~CpufreqWriter()
+{
+    stopping = true;
+    wake();
+    thread.join();
+    close(efd);
+
+    error_w.stop();
+    log_errors();
+    for (auto &p : policies) {
+        if (p.write_latency.count() == 0) continue;
+        logger->debug("Cpufreq policy '{}' write latency: {} ('{}' requests superseded)",
+                      p.name,
+                      p.write_latency.to_string(),
+                      p.superseded_requests);
+    }
+}
+
+void CpufreqWriter::set_priority()
+{
+    int policy = 0;
+    sched_param sp{};
+    int err = pthread_getschedparam(pthread_self(), &policy, &sp);
+    if (err == 0 && (policy == SCHED_FIFO || policy == SCHED_RR)) {
+        sp.sched_priority = std::max(sp.sched_priority - 1, sched_get_priority_min(policy));
+        err = pthread_setschedparam(thread.native_handle(), policy, &sp);
+    }
+    if (err != 0) {
+        logger->warn("Failed to set the priority of the cpufreq writer thread: {}",
+                     strerror(err));
+    }
+}
+
+void CpufreqWriter::wake() // NOLINT(readability-make-member-function-const)
+{
+    uint64_t buf = 1;
+    CHECK(write(efd, &buf, sizeof(buf)));
+}
+
+void CpufreqWriter::run()
+{
+    while (true) {
+        uint64_t buf;
+        // blocks until `notify()` or the destructor wakes us up
+        if (read(efd, &buf, sizeof(buf)) == -1) {
+            if (errno == EINTR) continue;
+            report_error(std::string("read: ") + strerror(errno));
+            return;
+        }
+        // cleared before the mailboxes are checked, so that a request stored
+        //  after the check triggers a new wake-up
+        wake_pending = false;
+        for (auto &p : policies) {
+            try {
+                p.write_requested_frequency();
+            } catch (const std::exception &e) {
+                failed_writes++;
+                report_error(e.what());
+            }
+        }
+        if (stopping) return;
+    }
+}
+
+void CpufreqWriter::report_error(std::string error_)
+{
+    {
+        std::lock_guard lock(error_mutex);
+        if (error_count++ == 0) error = std::move(error_);
+    }
+    error_w.write(1);
+}
+
+void CpufreqWriter::log_errors()
+{
+    std::string first;
+    uint64_t count = 0;
+    {
+        std::lock_guard lock(error_mutex);
+        std::swap(first, error);
+        std::swap(count, error_count);
+    }
+    if (count == 0) return;
+    logger->error(
+      "Asynchronous CPU frequency write failed ('{}' times since the last report): {}",
+      count,
+      first);
+}
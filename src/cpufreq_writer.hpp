@@ -0,0 +1,76 @@
+#pragma once
+
+#include "evfd.hpp"
+#include "lib/cpu_set.hpp"
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class CpufreqPolicy;
+
+/**
+ * Writes CPU frequencies from a dedicated thread, so that the scheduler thread
+ * does not block on the slow `scaling_setspeed` writes (~100-200 µs on i.MX8).
+ *
+ * Each `CpufreqPolicy` has a single-slot mailbox with the latest requested frequency.
+ * The scheduler thread (the only producer) stores the request into it with a single atomic
+ * exchange and wakes the writer thread through an eventfd, unless a wake-up is already
+ * pending. A request that was not written yet is superseded by a newer one for the same
+ * policy, as only the latest frequency matters. The writer thread records how long it took
+ * from the request until each write completed (see `CpufreqPolicy::write_latency`).
+ * Failed writes are reported to the event loop, which logs them, as the logger
+ * is not thread-safe.
+ *
+ * Enabled by the `DEMOS_ASYNC_CPUFREQ` environment variable.
+ */
+class CpufreqWriter
+{
+public:
+    /**
+     * Starts the writer thread for `policies`, running on `cpus`; its errors are logged
+     * from `loop`.
+     *
+     * If the calling thread has a real-time priority, the writer thread runs one level
+     * below it, so that it never delays the scheduler thread, but still preempts
+     * the scheduled processes.
+     */
+    CpufreqWriter(ev::loop_ref loop, std::list<CpufreqPolicy> &policies, const cpu_set &cpus);
+    /** Writes out the pending requests, stops the thread and logs the write latencies. */
+    ~CpufreqWriter();
+
+    CpufreqWriter(const CpufreqWriter &) = delete;
+    const CpufreqWriter &operator=(const CpufreqWriter &) = delete;
+
+    /** Called by the scheduler thread after a new request is stored. Does not block. */
+    void notify()
+    {
+        if (!wake_pending.exchange(true)) wake();
+    }
+
+    /** Number of failed writes so far. */
+    [[nodiscard]] uint64_t get_failed_writes() const { return failed_writes; }
+
+private:
+    std::list<CpufreqPolicy> &policies;
+    const int efd;
+    std::atomic<bool> wake_pending{ false };
+    std::atomic<bool> stopping{ false };
+    std::atomic<uint64_t> failed_writes{ 0 };
+    /** Signalled by the writer thread when it stores an error. */
+    ev::evfd error_w;
+    std::mutex error_mutex{};
+    /** First error not logged yet, and the number of errors since; guarded by `error_mutex`. */
+    std::string error{};
+    uint64_t error_count = 0;
+    std::thread thread{};
+
+    void set_priority();
+    void wake();
+    void run();
+    /** Called from the writer thread. */
+    void report_error(std::string error);
+    /** Called from the event loop (or after the writer thread stopped). */
+    void log_errors();
+};
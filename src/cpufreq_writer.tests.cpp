@@ -0,0 +1,67 @@
+#include "tests/acutest.h"
+
+#include "cpufreq_policy.hpp"
+#include "cpufreq_writer.hpp"
+#include "tests/fake_sysfs.hpp"
+
+static void test_writes()
+{
+    FakeSysfs sysfs("cpufreq");
+    {
+        std::list<CpufreqPolicy> policies;
+        policies.emplace_back(sysfs.add_cpufreq_policy());
+        auto &p = policies.front();
+        {
+            CpufreqWriter writer(ev::get_default_loop(), policies, cpu_set(0b1));
+            p.set_writer(&writer);
+            p.write_frequency(CpuFrequencyHz{ 600'000'000 });
+            p.write_frequency(CpuFrequencyHz{ 896'000'000 });
+            p.write_frequency(CpuFrequencyHz{ 1'200'000'000 });
+            // the destructor writes out the pending request
+        }
+        // the requests may have been coalesced, but the last one must be written last;
+        //  the writes append to the file, as it is not a real sysfs attribute
+        std::string written = sysfs.read("policy0/scaling_setspeed");
+        TEST_CHECK(written.size() >= 7);
+        TEST_CHECK(written.substr(written.size() - 7) == "1200000");
+        TEST_MSG("written: %s", written.c_str());
+
+        // back to synchronous writes
+        p.set_writer(nullptr);
+        p.write_frequency(CpuFrequencyHz{ 600'000'000 });
+        written = sysfs.read("policy0/scaling_setspeed");
+        TEST_CHECK(written.substr(written.size() - 6) == "600000");
+    }
+    // the original governor is restored by the policy destructor
+    TEST_CHECK(sysfs.read("policy0/scaling_governor") == "schedutil");
+}
+
+static void test_failed_write()
+{
+    FakeSysfs sysfs("cpufreq");
+    auto policy_dir = sysfs.add_cpufreq_policy();
+    // writes to /dev/full fail with ENOSPC
+    std::filesystem::remove(policy_dir / "scaling_setspeed");
+    std::filesystem::create_symlink("/dev/full", policy_dir / "scaling_setspeed");
+
+    std::list<CpufreqPolicy> policies;
+    policies.emplace_back(policy_dir);
+    auto &p = policies.front();
+    ev::default_loop loop;
+    CpufreqWriter writer(loop, policies, cpu_set(0b1));
+    p.set_writer(&writer);
+    p.write_frequency(CpuFrequencyHz{ 600'000'000 });
+    // the error is reported to the event loop, the writer thread keeps running
+    loop.run(ev::ONCE);
+    TEST_CHECK(writer.get_failed_writes() == 1);
+    p.write_frequency(CpuFrequencyHz{ 896'000'000 });
+    loop.run(ev::ONCE);
+    TEST_CHECK(writer.get_failed_writes() == 2);
+    p.set_writer(nullptr);
+}
+
+TEST_LIST = {
+    { "writes", test_writes },
+    { "failed_write", test_failed_write },
+    { nullptr, nullptr },
+};
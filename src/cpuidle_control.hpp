@@ -0,0 +1,155 @@
+#pragma once
+
+#include "lib/check_lib.hpp"
+#include "lib/cpu_set.hpp"
+#include "lib/file_lib.hpp"
+#include "log.hpp"
+#include <chrono>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+/**
+ * Limits the idle states (C-states) of CPUs running SC partitions, so that they wake up
+ * quickly at window and budget boundaries, while other CPUs may still enter deep idle states.
+ *
+ * Idle states with an exit latency above `max_latency` are disabled through
+ * `/sys/devices/system/cpu/cpu<n>/cpuidle/state<k>/disable` on the limited CPUs; on the other
+ * CPUs, the original setting of each state is kept. Only the states of CPUs whose limit
+ * changed are written, so a schedule running SC partitions on the same CPUs in each window
+ * only pays for the writes once.
+ *
+ * If `cpuidle` does not list any idle states in sysfs, a global PM QoS request is held
+ * through `/dev/cpu_dma_latency` instead, which limits all CPUs while any CPU is limited.
+ *
+ * Like `cpufreq` governors, the original settings are restored by the destructor.
+ *
+ * https://www.kernel.org/doc/html/latest/admin-guide/pm/cpuidle.html
+ */
+class CpuIdleControl
+{
+public:
+    /**
+     * @param max_latency - longest exit latency of the idle states allowed on limited CPUs
+     * @param cpu_dir - the sysfs CPU directory, changed by tests
+     */
+    explicit CpuIdleControl(std::chrono::microseconds max_latency,
+                            const fs::path &cpu_dir = "/sys/devices/system/cpu")
+        : max_latency(max_latency)
+    {
+        for (const auto &entry : fs::directory_iterator(cpu_dir)) {
+            // only cpu<n> directories of online CPUs have the `cpuidle` subdirectory
+            std::string name = entry.path().filename();
+            if (name.rfind("cpu", 0) != 0 || name.size() == 3 || !isdigit(name[3])) continue;
+            if (!fs::exists(entry.path() / "cpuidle")) continue;
+            Cpu cpu{ static_cast<unsigned>(std::stoul(name.substr(3))), {}, false };
+            for (const auto &state : fs::directory_iterator(entry.path() / "cpuidle")) {
+                if (state.path().filename().string().rfind("state", 0) != 0) continue;
+                if (read_number(state.path() / "latency") <= max_latency.count()) continue;
+                auto disable = state.path() / "disable";
+                cpu.deep_states.push_back(
+                  { CHECK_MSG(open(disable.c_str(), O_WRONLY | O_CLOEXEC),
+                              "Cannot open '" + disable.string() + "'"),
+                    read_number(disable) != 0 });
+            }
+            cpus.push_back(std::move(cpu));
+        }
+
+        if (cpus.empty()) {
+            fd_dma_latency = CHECK_MSG(open("/dev/cpu_dma_latency", O_WRONLY | O_CLOEXEC),
+                                       "Cannot open '/dev/cpu_dma_latency'");
+            logger->debug("No per-CPU idle states found, using a global CPU latency request");
+            write_dma_latency(no_constraint);
+        } else {
+            logger->debug("Limiting idle states to an exit latency of '{} µs' on CPUs running "
+                          "SC partitions ('{}' CPUs with cpuidle)",
+                          max_latency.count(),
+                          cpus.size());
+        }
+    }
+
+    CpuIdleControl(const CpuIdleControl &) = delete;
+    CpuIdleControl &operator=(const CpuIdleControl &) = delete;
+
+    ~CpuIdleControl()
+    {
+        for (Cpu &cpu : cpus) {
+            try {
+                if (cpu.limited) set_limited(cpu, false);
+            } catch (const std::exception &e) {
+                logger->error("Failed to restore idle states: {}", e.what());
+            }
+            for (auto &s : cpu.deep_states) close(s.fd);
+        }
+        // closing the file removes the request
+        if (fd_dma_latency != -1) close(fd_dma_latency);
+    }
+
+    /** Limits the idle states of `limited_cpus`, and restores them on all other CPUs. */
+    void limit(const cpu_set &limited_cpus)
+    {
+        if (fd_dma_latency != -1) {
+            write_dma_latency(limited_cpus ? static_cast<int32_t>(max_latency.count())
+                                           : no_constraint);
+            return;
+        }
+        for (Cpu &cpu : cpus) {
+            bool limited = limited_cpus.is_set(cpu.id);
+            if (limited != cpu.limited) set_limited(cpu, limited);
+        }
+    }
+
+private:
+    /** Value of a PM QoS CPU latency request without any constraint. */
+    static constexpr int32_t no_constraint = 2'000'000'000;
+
+    struct IdleState
+    {
+        /** `disable` attribute of the state. */
+        int fd;
+        bool originally_disabled;
+    };
+    struct Cpu
+    {
+        unsigned id;
+        /** States with an exit latency above `max_latency`. */
+        std::vector<IdleState> deep_states;
+        bool limited;
+    };
+
+    const std::chrono::microseconds max_latency;
+    std::vector<Cpu> cpus{};
+    int fd_dma_latency = -1;
+    int32_t current_dma_latency = 0;
+
+    static void set_limited(Cpu &cpu, bool limited)
+    {
+        for (auto &s : cpu.deep_states) {
+            const char *value = limited || s.originally_disabled ? "1" : "0";
+            CHECK_MSG(write(s.fd, value, 1),
+                      "Cannot change idle states of CPU " + std::to_string(cpu.id));
+        }
+        cpu.limited = limited;
+    }
+
+    void write_dma_latency(int32_t latency_us)
+    {
+        if (latency_us == current_dma_latency) return;
+        CHECK_MSG(write(fd_dma_latency, &latency_us, sizeof(latency_us)),
+                  "Cannot write to '/dev/cpu_dma_latency'");
+        current_dma_latency = latency_us;
+    }
+
+    static int64_t read_number(const fs::path &path)
+    {
+        auto is = file_open<std::ifstream>(path);
+        int64_t value;
+        is >> value;
+        return value;
+    }
+};
@@ -0,0 +1,60 @@
+#include "tests/acutest.h"
+
+#include "cpuidle_control.hpp"
+#include "tests/fake_sysfs.hpp"
+
+static fs::path state_dir(int cpu, int state)
+{
+    return fs::path("cpu" + std::to_string(cpu)) / "cpuidle" / ("state" + std::to_string(state));
+}
+
+/**
+ * Creates fake sysfs CPU directories for 2 CPUs, each with idle states with exit latencies
+ * of 0, 50 and 500 µs; the deepest state of cpu1 is disabled.
+ */
+static void add_cpus(const FakeSysfs &sysfs)
+{
+    for (int cpu = 0; cpu < 2; cpu++) {
+        int latencies[] = { 0, 50, 500 };
+        for (int i = 0; i < 3; i++) {
+            sysfs.set(state_dir(cpu, i) / "latency", latencies[i]);
+            sysfs.set(state_dir(cpu, i) / "disable", cpu == 1 && i == 2 ? 1 : 0);
+        }
+    }
+    fs::create_directories(sysfs.path() / "cpufreq");
+}
+
+/** Last value written to the `disable` attribute (the writes append to a regular file). */
+static char disabled(const FakeSysfs &sysfs, int cpu, int state)
+{
+    return sysfs.read(state_dir(cpu, state) / "disable").back();
+}
+
+static void test_limit()
+{
+    FakeSysfs sysfs("cpuidle");
+    add_cpus(sysfs);
+    {
+        CpuIdleControl idle(std::chrono::microseconds(100), sysfs.path());
+        idle.limit(cpu_set(0b01));
+        TEST_CHECK(disabled(sysfs, 0, 1) == '0');
+        TEST_CHECK(disabled(sysfs, 0, 2) == '1');
+        TEST_CHECK(disabled(sysfs, 1, 2) == '1');
+
+        idle.limit(cpu_set(0b10));
+        TEST_CHECK(disabled(sysfs, 0, 2) == '0');
+        TEST_CHECK(disabled(sysfs, 1, 1) == '0');
+        TEST_CHECK(disabled(sysfs, 1, 2) == '1');
+
+        idle.limit(cpu_set(0b11));
+        TEST_CHECK(disabled(sysfs, 0, 2) == '1');
+    }
+    // the original settings are restored
+    TEST_CHECK(disabled(sysfs, 0, 2) == '0');
+    TEST_CHECK(disabled(sysfs, 1, 2) == '1');
+}
+
+TEST_LIST = {
+    { "limit", test_limit },
+    { nullptr, nullptr },
+};
@@ -1,10 +1,14 @@
 #pragma once
 
+#include "config.hpp"
+#include "control_socket.hpp"
 #include "log.hpp"
 #include "majorframe.hpp"
 #include "memory_tracker.hpp"
 #include "partition_manager.hpp"
 #include "slice.hpp"
+#include "startup_report.hpp"
+#include "trace.hpp"
 #include <chrono>
 #include <ev++.h>
 
@@ -16,17 +20,35 @@ private:
     PartitionManager partition_manager;
     ev::sig sigint{ loop };
     ev::sig sigterm{ loop };
+    ev::sig sigusr1{ loop };
+    ev::sig sigusr2{ loop };
+    ev::sig sighup{ loop };
     std::optional<std::chrono::milliseconds> timeout{};
     ev::timerfd timeout_timer{ loop };
+    /** Drains the schedule trace ring, see `ScheduleTrace::drain_interval`. */
+    ev::timerfd trace_drain_timer{ loop };
+    std::optional<ControlSocket> control_socket{};
+    /** Set when the window scheduler was paused by the `pause` control command. */
+    bool paused = false;
+    /** Set between the `pause` control command and the end of the major frame. */
+    bool pause_pending = false;
+    StartupReport startup_report{};
+
+    // configuration reloading, see `enable_reload`
+    std::optional<std::filesystem::path> config_file{};
+    std::optional<CgroupConfig> cgroup_config{};
+    cpu_set allowed_cpus{};
+    /** New configuration waiting to be applied at the end of the major frame. */
+    std::optional<Config> pending_config{};
 
 public:
     DemosScheduler(ev::loop_ref ev_loop,
                    Partitions &&partitions,
-                   Windows &&windows,
+                   Modes &&modes,
                    const std::string &window_sync_message,
                    const std::string &mf_sync_message)
         : loop(ev_loop)
-        , mf(loop, std::move(windows), window_sync_message, mf_sync_message)
+        , mf(loop, std::move(modes), window_sync_message, mf_sync_message)
         , partition_manager(std::move(partitions))
     {
         // setup completion callback
@@ -34,11 +56,107 @@ public:
         // setup signal handlers
         sigint.set<DemosScheduler, &DemosScheduler::signal_cb>(this);
         sigterm.set<DemosScheduler, &DemosScheduler::signal_cb>(this);
+        sigusr1.set<DemosScheduler, &DemosScheduler::stats_signal_cb>(this);
+        sigusr2.set<DemosScheduler, &DemosScheduler::mode_signal_cb>(this);
+        sighup.set<DemosScheduler, &DemosScheduler::reload_signal_cb>(this);
         timeout_timer.set([this] { timeout_cb(); });
+        // draining must not delay the scheduling, similarly to the control socket
+        trace_drain_timer.priority = EV_MINPRI;
+        trace_drain_timer.set([this] { trace_drain_cb(); });
+    }
+
+    /**
+     * Sets up scheduler for running. Currently only spawns system processes.
+     *
+     * @param report - durations of the startup phases so far; the remaining
+     *  phases are added to it, and it is logged when the scheduler starts
+     */
+    void setup(StartupReport &&report)
+    {
+        startup_report = std::move(report);
+        partition_manager.create_processes(mf);
+        startup_report.end_phase("spawn");
+    }
+
+    /** Starts listening for control commands (see `control_cb`) on a Unix socket at `path`. */
+    void enable_control_socket(const std::filesystem::path &path)
+    {
+        control_socket.emplace(
+          loop, path, [this](const std::string &command) { return control_cb(command); });
     }
 
-    /** Sets up scheduler for running. Currently only spawns system processes. */
-    void setup() { partition_manager.create_processes(); }
+    /** Measures the energy consumed by each window and partition, see `MajorFrame`. */
+    void enable_energy_accounting(const std::filesystem::path &sysfs_root)
+    {
+        mf.enable_energy_accounting(sysfs_root);
+    }
+
+    /**
+     * Allows reloading the configuration from `config_file_` on SIGHUP
+     * or the `reload` control command (see `reload()`).
+     *
+     * @param allowed_cpus_ - CPU affinity of DEmOS before `demos_cpu` was applied
+     */
+    void enable_reload(const std::filesystem::path &config_file_,
+                       const CgroupConfig &cc,
+                       const cpu_set &allowed_cpus_)
+    {
+        config_file = config_file_;
+        cgroup_config.emplace(cc);
+        allowed_cpus = allowed_cpus_;
+        sighup.start(SIGHUP);
+    }
+
+    /**
+     * Parses the configuration file and, if it is valid, applies it at the end of the current
+     * major frame (or immediately, if paused). Partitions and processes with an unchanged
+     * definition keep running; only removed processes are killed, and new ones are spawned
+     * and initialized before the next major frame starts.
+     *
+     * The new scheduler objects are first built from scratch and checked by the power policy
+     * (see `Config::check_scheduler_objects`), so that an invalid configuration is reported
+     * here and the current one is kept. This creates and removes a cgroup for each partition
+     * and process, which may delay the current window.
+     *
+     * Returns a reply for the control socket.
+     */
+    std::string reload()
+    {
+        if (!config_file) return "error: reloading requires a configuration file (-c)";
+        if (pending_config || mf.is_stop_pending()) {
+            return "error: reload, pause or drain already pending";
+        }
+        if (!mf.is_running() && !paused) return "error: scheduler is not running";
+
+        logger->info("Reloading configuration from '{}'", config_file->string());
+        memory_tracker::disable();
+        try {
+            // this is done before the end of the major frame, so that an invalid
+            //  config does not disturb the schedule, and the switch is shorter
+            Config new_config;
+            new_config.load_from_file(*config_file);
+            new_config.normalize();
+            new_config.check_scheduler_objects(*cgroup_config, allowed_cpus);
+            pending_config = std::move(new_config);
+        } catch (const std::exception &e) {
+            logger->error("Invalid configuration, keeping the current one: {}", e.what());
+            memory_tracker::enable();
+            return std::string("error: ") + e.what();
+        }
+
+        if (paused) {
+            if (!apply_pending_config()) {
+                return "error: failed to apply the new configuration, stopping all processes";
+            }
+            return "ok: reloaded";
+        }
+        memory_tracker::enable();
+        mf.stop_at_mf_end([this] {
+            // windows cannot be replaced from inside of the window timer callback
+            loop.once<DemosScheduler, &DemosScheduler::apply_pending_config_cb>(-1, 0, 0, this);
+        });
+        return "ok: reloading at the end of the major frame";
+    }
 
     /**
      * Runs the scheduler in the event loop passed in constructor.
@@ -58,6 +176,8 @@ public:
         // start signal handlers
         sigint.start(SIGINT);
         sigterm.start(SIGTERM);
+        sigusr1.start(SIGUSR1);
+        sigusr2.start(SIGUSR2);
 
         logger->debug("Starting event loop");
         loop.run();
@@ -84,6 +204,8 @@ public:
         //  (`kill_all` call below unfreezes all processes, and if scheduler was running,
         //  they would get frozen again at the end of the window, potentially before exiting)
         mf.stop(std::chrono::steady_clock::now());
+        pending_config = std::nullopt;
+        pause_pending = false;
 
         // this should trigger completion_cb() when scheduler is running,
         //  and at the same time allows for graceful async cleanup
@@ -91,6 +213,44 @@ public:
     }
 
 private:
+    void apply_pending_config_cb() { apply_pending_config(); }
+
+    /** Returns false if the configuration could not be applied and the scheduler is stopping. */
+    bool apply_pending_config()
+    {
+        if (!pending_config) return true; // cancelled by shutdown
+        ASSERT(!mf.is_running());
+        memory_tracker::disable();
+        Modes modes;
+        Partitions removed;
+        try {
+            partition_manager.prune_retired();
+            pending_config->update_scheduler_objects(*cgroup_config,
+                                                     allowed_cpus,
+                                                     modes,
+                                                     partition_manager.get_partitions(),
+                                                     removed);
+        } catch (const std::exception &e) {
+            // the partitions may be partially updated, so we cannot continue
+            pending_config = std::nullopt;
+            logger->error("Failed to apply the new configuration, stopping all processes: {}",
+                          e.what());
+            initiate_shutdown();
+            return false;
+        }
+        pending_config = std::nullopt;
+        // the old windows refer to the removed partitions, replace them first
+        mf.replace_modes(std::move(modes));
+        partition_manager.retire_partitions(std::move(removed));
+        partition_manager.create_processes(mf);
+        partition_manager.run_process_init(mf, [this] {
+            logger->info("New configuration applied");
+            memory_tracker::enable();
+            if (!paused) mf.start(std::chrono::steady_clock::now());
+        });
+        return true;
+    }
+
     void startup_fn()
     {
         partition_manager.run_process_init(mf, [this] { start_scheduler(); });
@@ -98,6 +258,13 @@ private:
 
     void start_scheduler()
     {
+        startup_report.end_phase("init");
+        size_t process_count = 0;
+        for (auto &p : partition_manager.get_partitions()) {
+            process_count += p.processes.size();
+        }
+        startup_report.log(process_count);
+
         if (timeout && timeout.value() == timeout->zero()) {
             // useful for measuring startup time
             logger->info("Zero timeout set, stopping immediately");
@@ -108,7 +275,10 @@ private:
         logger->info("Starting scheduler");
         memory_tracker::enable();
         auto start_time = std::chrono::steady_clock::now();
-        Slice::start_time = start_time;
+        schedule_trace.start(start_time);
+        if (schedule_trace.is_requested()) {
+            trace_drain_timer.start(start_time + ScheduleTrace::drain_interval);
+        }
         mf.start(start_time);
         if (timeout) {
             logger->debug("Scheduler will timeout in '{} ms'", timeout->count());
@@ -129,8 +299,11 @@ private:
     {
         logger->info("All processes exited, stopping scheduler");
         memory_tracker::disable();
+        partition_manager.log_freeze_stats();
+        mf.log_timing_stats(spdlog::level::info);
         // stop the scheduler
         mf.stop(std::chrono::steady_clock::now());
+        mf.log_energy_stats();
         // stop the event loop; ev automatically handles all pending events before stopping
         loop.break_loop(ev::ALL);
     }
@@ -142,10 +315,124 @@ private:
         initiate_shutdown();
     }
 
+    /**
+     * Handles a command received on the control socket and returns the reply.
+     *
+     * Supported commands:
+     *  - `stats` - scheduler counters and budget consumed by each process
+     *  - `pause` - stop the window scheduler at the end of the current major frame
+     *  - `resume` - start a new major frame after `pause`
+     *  - `drain` - stop all processes after the current major frame completes
+     *  - `mode <name>` - switch to another mode at the end of the current major frame
+     *  - `reload` - reload the configuration file, see `reload()`
+     */
+    std::string control_cb(const std::string &command)
+    {
+        logger->debug("Received control command '{}'", command);
+        if (command == "stats") {
+            return format_stats();
+        } else if (command == "pause") {
+            if (paused || mf.is_stop_pending()) return "error: already paused or draining";
+            if (!mf.is_running()) return "error: scheduler is not running";
+            pause_pending = true;
+            mf.stop_at_mf_end([this] {
+                pause_pending = false;
+                paused = true;
+                logger->info("Scheduler paused");
+            });
+            return "ok: pausing at the end of the major frame";
+        } else if (command == "resume") {
+            if (pause_pending) {
+                // pause was requested, but the major frame did not end yet
+                pause_pending = false;
+                mf.stop_at_mf_end(nullptr);
+                return "ok: pending pause cancelled";
+            }
+            if (mf.is_stop_pending()) return "error: drain or reload pending";
+            if (!paused) return "error: scheduler is not paused";
+            paused = false;
+            logger->info("Scheduler resumed");
+            mf.start(std::chrono::steady_clock::now());
+            return "ok: resumed";
+        } else if (command == "drain") {
+            if (!mf.is_running()) {
+                // paused, or still initializing processes
+                logger->info("Drain requested, stopping all processes");
+                initiate_shutdown();
+                return "ok: stopping";
+            }
+            pause_pending = false;
+            mf.stop_at_mf_end([this] {
+                logger->info("Major frame completed after drain request, stopping all processes");
+                initiate_shutdown();
+            });
+            return "ok: stopping after the current major frame";
+        } else if (command == "reload") {
+            return reload();
+        } else if (command.rfind("mode ", 0) == 0) {
+            auto name = command.substr(5);
+            if (!mf.switch_mode(name)) return "error: unknown mode '" + name + "'";
+            logger->info("Switching to mode '{}' at the end of the major frame", name);
+            return "ok: switching to mode '" + name + "'";
+        }
+        return "error: unknown command '" + command + "'";
+    }
+
+    [[nodiscard]] std::string format_stats() const
+    {
+        const char *state = paused               ? "paused"
+                            : mf.is_stop_pending() ? "stopping"
+                            : mf.is_running()      ? "running"
+                                                   : "stopped";
+        std::string str = fmt::format(
+          "state: {}\nmode: {}\nwindows: {}\nmajor_frames: {}\nsc_overruns: {}\n",
+                                      state,
+                                      mf.get_mode_name(),
+                                      mf.get_windows_executed(),
+                                      mf.get_mf_counter(),
+                                      mf.get_sc_overruns());
+        for (auto &part : partition_manager.get_partitions()) {
+            for (auto &proc : part.processes) {
+                auto &s = proc.get_run_stats();
+                auto &o = proc.get_overrun_stats();
+                str += fmt::format("process {} '{}': consumed_ms={:.3f} runs={} "
+                                   "budget_exhausted={} overruns={} skipped={} restarts={}\n",
+                                   part.get_name(),
+                                   proc.argv,
+                                   static_cast<double>(s.consumed.count()) / 1e6,
+                                   s.runs,
+                                   s.budget_exhausted,
+                                   o.overruns,
+                                   o.skipped,
+                                   o.restarts);
+            }
+        }
+        return str;
+    }
+
+    /** Called when our process receives SIGUSR1. */
+    void stats_signal_cb() { mf.log_timing_stats(spdlog::level::info); }
+
+    /** Called when our process receives SIGHUP. */
+    void reload_signal_cb() { reload(); }
+
+    /** Called when our process receives SIGUSR2. Cycles to the next mode. */
+    void mode_signal_cb()
+    {
+        mf.switch_to_next_mode();
+        logger->info("Switching to the next mode at the end of the major frame");
+    }
+
     /** Called on expiration of the timeout configured by the user. Stops the scheduler. */
     void timeout_cb()
     {
         logger->info("Timed out, stopping all processes");
         initiate_shutdown();
     }
+
+    void trace_drain_cb()
+    {
+        schedule_trace.drain();
+        trace_drain_timer.start(std::chrono::steady_clock::now() + ScheduleTrace::drain_interval);
+    }
 };
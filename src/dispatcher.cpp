@@ -0,0 +1,69 @@
+#include "dispatcher.hpp"
+#include "lib/assert.hpp"
+
+TimerDispatcher::TimerDispatcher(ev::loop_ref loop)
+    : timer(loop)
+{
+    timer.set([this] { timeout_cb(); });
+}
+
+TimerDispatcher::Slot TimerDispatcher::add_slot(std::function<void()> callback)
+{
+    ASSERT(armed == time_point::max());
+    slots.push_back({ time_point::max(), std::move(callback), {} });
+    return slots.size() - 1;
+}
+
+void TimerDispatcher::arm(Slot slot, time_point deadline)
+{
+    slots[slot].deadline = deadline;
+    // while dispatching, the timer is re-armed once all callbacks are done
+    if (!dispatching && deadline < armed) {
+        armed = deadline;
+        timer.start(deadline);
+    }
+}
+
+void TimerDispatcher::disarm(Slot slot)
+{
+    // the timerfd is not touched; if it fires for a disarmed slot, nothing
+    //  is dispatched and it is re-armed for the next pending deadline
+    slots[slot].deadline = time_point::max();
+}
+
+void TimerDispatcher::remove_slots(Slot first)
+{
+    ASSERT(!dispatching);
+    for (auto it = slots.begin() + first; it != slots.end(); it++) {
+        ASSERT(it->deadline == time_point::max());
+    }
+    slots.erase(slots.begin() + first, slots.end());
+}
+
+void TimerDispatcher::rearm()
+{
+    armed = time_point::max();
+    for (auto &e : slots) {
+        if (e.deadline < armed) armed = e.deadline;
+    }
+    if (armed != time_point::max()) {
+        timer.start(armed);
+    }
+}
+
+void TimerDispatcher::timeout_cb()
+{
+    time_point now = armed;
+    auto wakeup_time = std::chrono::steady_clock::now();
+    dispatching = true;
+    // callbacks may arm or disarm other slots; a slot disarmed by an earlier
+    //  callback is skipped, a slot armed with a new deadline is dispatched later
+    for (auto &e : slots) {
+        if (e.deadline > now) continue;
+        e.lateness.record(wakeup_time - e.deadline);
+        e.deadline = time_point::max();
+        e.callback();
+    }
+    dispatching = false;
+    rearm();
+}
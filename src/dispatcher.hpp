@@ -0,0 +1,63 @@
+#pragma once
+
+#include "histogram.hpp"
+#include "timerfd.hpp"
+#include <chrono>
+#include <ev++.h>
+#include <functional>
+#include <vector>
+
+/**
+ * Multiplexes the deadlines of all scheduler timers onto a single timerfd.
+ *
+ * Each timer gets a slot during setup, and the slots are stored in a contiguous
+ * array. When multiple deadlines expire at the same time, their callbacks are
+ * called in the order in which the slots were added.
+ *
+ * For each slot, the dispatcher keeps a histogram of how late after the deadline
+ * the expiration was handled.
+ */
+class TimerDispatcher
+{
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+    using Slot = size_t;
+
+    explicit TimerDispatcher(ev::loop_ref loop);
+
+    TimerDispatcher(const TimerDispatcher &) = delete;
+    const TimerDispatcher &operator=(const TimerDispatcher &) = delete;
+
+    /** Adds a new timer slot. Must not be called after the first `arm(...)`. */
+    Slot add_slot(std::function<void()> callback);
+    /** Sets the (absolute) deadline of the slot, replacing the previous one. */
+    void arm(Slot slot, time_point deadline);
+    void disarm(Slot slot);
+    /**
+     * Removes `first` and all slots added after it, so that new slots can be added.
+     * All removed slots must be disarmed, and it must not be called from a slot callback.
+     */
+    void remove_slots(Slot first);
+
+    [[nodiscard]] const Log2Histogram &get_lateness(Slot slot) const
+    {
+        return slots[slot].lateness;
+    }
+
+private:
+    struct Entry
+    {
+        time_point deadline;
+        std::function<void()> callback;
+        Log2Histogram lateness{};
+    };
+
+    ev::timerfd timer;
+    std::vector<Entry> slots{};
+    /** Deadline the timerfd is currently set to. */
+    time_point armed = time_point::max();
+    bool dispatching = false;
+
+    void rearm();
+    void timeout_cb();
+};
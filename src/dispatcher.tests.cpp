@@ -0,0 +1,90 @@
+#include "tests/acutest.h"
+
+#include "dispatcher.hpp"
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+static void test_order()
+{
+    ev::default_loop loop;
+    TimerDispatcher d(loop);
+    vector<int> fired;
+
+    auto now = steady_clock::now();
+    TimerDispatcher::Slot s0 = d.add_slot([&] { fired.push_back(0); });
+    TimerDispatcher::Slot s1 = d.add_slot([&] { fired.push_back(1); });
+    TimerDispatcher::Slot s2 = d.add_slot([&] { fired.push_back(2); });
+
+    // slots expiring at the same time are dispatched in the order of creation
+    d.arm(s2, now + 2ms);
+    d.arm(s1, now + 1ms);
+    d.arm(s0, now + 1ms);
+    loop.run();
+
+    TEST_CHECK(fired == vector<int>({ 0, 1, 2 }));
+}
+
+static void test_disarm_from_callback()
+{
+    ev::default_loop loop;
+    TimerDispatcher d(loop);
+    vector<int> fired;
+
+    auto now = steady_clock::now();
+    TimerDispatcher::Slot s1 = 0;
+    TimerDispatcher::Slot s0 = d.add_slot([&] {
+        fired.push_back(0);
+        d.disarm(s1);
+    });
+    s1 = d.add_slot([&] { fired.push_back(1); });
+
+    d.arm(s0, now + 1ms);
+    d.arm(s1, now + 1ms);
+    loop.run();
+
+    TEST_CHECK(fired == vector<int>({ 0 }));
+}
+
+static void test_rearm_from_callback()
+{
+    ev::default_loop loop;
+    TimerDispatcher d(loop);
+    int count = 0;
+
+    TimerDispatcher::Slot s = 0;
+    s = d.add_slot([&] {
+        if (++count < 3) d.arm(s, steady_clock::now() + 1ms);
+    });
+    d.arm(s, steady_clock::now());
+    loop.run();
+
+    TEST_CHECK(count == 3);
+}
+
+static void test_remove_slots()
+{
+    ev::default_loop loop;
+    TimerDispatcher d(loop);
+    vector<int> fired;
+
+    auto s0 = d.add_slot([&] { fired.push_back(0); });
+    d.add_slot([&] { fired.push_back(1); });
+    d.remove_slots(1);
+    auto s2 = d.add_slot([&] { fired.push_back(2); });
+    TEST_CHECK(s2 == 1);
+
+    auto now = steady_clock::now();
+    d.arm(s2, now + 1ms);
+    d.arm(s0, now + 1ms);
+    loop.run();
+
+    TEST_CHECK(fired == vector<int>({ 0, 2 }));
+}
+
+TEST_LIST = { { "order", test_order },
+              { "disarm from callback", test_disarm_from_callback },
+              { "rearm from callback", test_rearm_from_callback },
+              { "remove slots", test_remove_slots },
+              { 0 } };
@@ -0,0 +1,106 @@
+#include "energy_meter.hpp"
+#include "lib/check_lib.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+/** Sorted entries of `dir` whose name starts with `prefix`; empty if `dir` does not exist. */
+static std::vector<fs::path> list_dir(const fs::path &dir, const std::string &prefix)
+{
+    std::vector<fs::path> entries;
+    std::error_code ec;
+    for (const auto &entry : fs::directory_iterator(dir, ec)) {
+        if (entry.path().filename().string().rfind(prefix, 0) == 0) {
+            entries.push_back(entry.path());
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+EnergyMeter::EnergyMeter(const fs::path &sysfs_root)
+{
+    for (const auto &zone : list_dir(sysfs_root / "class/powercap", "")) {
+        // subzones (e.g. `intel-rapl:0:0`) are included in their parent zone
+        auto name = zone.filename().string();
+        if (std::count(name.begin(), name.end(), ':') != 1) continue;
+        if (!fs::exists(zone / "energy_uj")) continue;
+        uint64_t max_range = 0;
+        std::ifstream(zone / "max_energy_range_uj") >> max_range;
+        add_sensor(sysfs_root, zone / "energy_uj", false, max_range);
+    }
+    for (const auto &hwmon : list_dir(sysfs_root / "class/hwmon", "hwmon")) {
+        for (const auto &path : list_dir(hwmon, "energy")) {
+            if (path.string().rfind("_input") == path.string().size() - 6) {
+                add_sensor(sysfs_root, path, false, 0);
+            }
+        }
+        for (const auto &path : list_dir(hwmon, "power")) {
+            if (path.string().rfind("_input") == path.string().size() - 6) {
+                add_sensor(sysfs_root, path, true, 0);
+            }
+        }
+    }
+}
+
+EnergyMeter::~EnergyMeter()
+{
+    for (auto &s : sensors) close(s.fd);
+}
+
+void EnergyMeter::add_sensor(const fs::path &sysfs_root,
+                             const fs::path &path,
+                             bool is_power,
+                             uint64_t max_range)
+{
+    // RAPL counters are only readable by root on recent kernels
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        logger->warn("Cannot open energy sensor '{}': {}", path.string(), strerror(errno));
+        return;
+    }
+    sensors.push_back({ path.lexically_relative(sysfs_root).string(), fd, is_power, max_range });
+}
+
+std::vector<std::string> EnergyMeter::sensor_names() const
+{
+    std::vector<std::string> names;
+    for (auto &s : sensors) names.push_back(s.name);
+    return names;
+}
+
+uint64_t EnergyMeter::read(int fd)
+{
+    char buf[32];
+    ssize_t len = CHECK(pread(fd, buf, sizeof(buf) - 1, 0));
+    buf[len] = '\0';
+    return strtoull(buf, nullptr, 10);
+}
+
+double EnergyMeter::sample(time_point now)
+{
+    double energy_uj = 0;
+    double elapsed_s = std::chrono::duration<double>(now - last_sample).count();
+    for (auto &s : sensors) {
+        uint64_t value = read(s.fd);
+        if (sampled) {
+            if (s.is_power) {
+                // trapezoidal rule, µW * s = µJ
+                energy_uj += static_cast<double>(s.last + value) / 2 * elapsed_s;
+            } else if (value >= s.last) {
+                energy_uj += static_cast<double>(value - s.last);
+            } else {
+                // the counter wrapped around (at most once, the range is minutes at full power)
+                energy_uj += static_cast<double>(s.max_range - s.last + value);
+            }
+        }
+        s.last = value;
+    }
+    last_sample = now;
+    sampled = true;
+    return energy_uj;
+}
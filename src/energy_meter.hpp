@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+/**
+ * Measures the energy consumed by the whole system, using the sensors exposed in sysfs:
+ *  - powercap zones (`class/powercap/<zone>/energy_uj`, e.g. Intel RAPL), which are energy
+ *    counters that wrap around at `max_energy_range_uj`; only top-level zones are used,
+ *    as their subzones (e.g. `intel-rapl:0:0`) are already included in them,
+ *  - hwmon energy counters (`class/hwmon/hwmon<n>/energy<k>_input`, in µJ),
+ *  - hwmon power sensors (`class/hwmon/hwmon<n>/power<k>_input`, in µW), found on some
+ *    ARM boards, which are integrated over time (so the result is only as precise as
+ *    the sampling period allows).
+ *
+ * The files are opened once and read by `pread(...)` in each `sample(...)`; reading them does
+ * not allocate, so it can be done while the scheduler is running.
+ */
+class EnergyMeter
+{
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    /** @param sysfs_root - usually `/sys`, changed by tests */
+    explicit EnergyMeter(const std::filesystem::path &sysfs_root);
+    ~EnergyMeter();
+
+    EnergyMeter(const EnergyMeter &) = delete;
+    const EnergyMeter &operator=(const EnergyMeter &) = delete;
+
+    [[nodiscard]] bool has_sensors() const { return !sensors.empty(); }
+    /** Paths of the used sensors, relative to the sysfs root. */
+    [[nodiscard]] std::vector<std::string> sensor_names() const;
+
+    /**
+     * Reads all sensors and returns the energy consumed since the previous call, in µJ.
+     * The first call only records the initial state and returns 0.
+     */
+    double sample(time_point now);
+
+private:
+    struct Sensor
+    {
+        std::string name;
+        int fd;
+        /** If true, the sensor reports power in µW, otherwise it is an energy counter in µJ. */
+        bool is_power;
+        /** The counter wraps around to 0 after this value; 0 if it does not wrap. */
+        uint64_t max_range;
+        uint64_t last = 0;
+    };
+
+    std::vector<Sensor> sensors{};
+    time_point last_sample{};
+    bool sampled = false;
+
+    void add_sensor(const std::filesystem::path &sysfs_root,
+                    const std::filesystem::path &path,
+                    bool is_power,
+                    uint64_t max_range);
+    static uint64_t read(int fd);
+};
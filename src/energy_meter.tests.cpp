@@ -0,0 +1,61 @@
+#include "tests/acutest.h"
+
+#include "energy_meter.hpp"
+#include "tests/fake_sysfs.hpp"
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+/**
+ * Creates a fake sysfs tree with a RAPL package zone (and its subzone, which must be ignored)
+ * and a hwmon power sensor.
+ */
+static void add_sensors(const FakeSysfs &sysfs)
+{
+    sysfs.set("class/powercap/intel-rapl:0/energy_uj", 900);
+    sysfs.set("class/powercap/intel-rapl:0/max_energy_range_uj", 1000);
+    sysfs.set("class/powercap/intel-rapl:0:0/energy_uj", 0);
+    sysfs.set("class/hwmon/hwmon0/power1_input", 2'000'000);
+    sysfs.set("class/hwmon/hwmon0/name", "ina231");
+}
+
+static void test_sample()
+{
+    FakeSysfs sysfs("energy");
+    add_sensors(sysfs);
+    EnergyMeter meter(sysfs.path());
+    TEST_CHECK(meter.sensor_names() == std::vector<std::string>({
+                                         "class/powercap/intel-rapl:0/energy_uj",
+                                         "class/hwmon/hwmon0/power1_input",
+                                       }));
+
+    EnergyMeter::time_point t{};
+    TEST_CHECK(meter.sample(t) == 0);
+
+    // 50 µJ from RAPL, 2 W for 1 ms from hwmon
+    sysfs.set("class/powercap/intel-rapl:0/energy_uj", 950);
+    double e = meter.sample(t + 1ms);
+    TEST_CHECK(e == 50 + 2000);
+    TEST_MSG("%f", e);
+
+    // RAPL wraps around; the power goes from 2 W to 4 W
+    sysfs.set("class/powercap/intel-rapl:0/energy_uj", 30);
+    sysfs.set("class/hwmon/hwmon0/power1_input", 4'000'000);
+    e = meter.sample(t + 2ms);
+    TEST_CHECK(e == 80 + 3000);
+    TEST_MSG("%f", e);
+}
+
+static void test_no_sensors()
+{
+    initialize_logger("%v", false, false);
+    EnergyMeter meter("/nonexistent");
+    TEST_CHECK(!meter.has_sensors());
+    TEST_CHECK(meter.sample({}) == 0);
+}
+
+TEST_LIST = {
+    { "sample", test_sample },
+    { "no_sensors", test_no_sensors },
+    { nullptr, nullptr },
+};
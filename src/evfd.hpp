@@ -11,6 +11,7 @@ public:
     explicit evfd(ev::loop_ref loop);
     void set(std::function<void(ev::evfd &)> callback_);
     int get_fd();
+    using io::priority;
     using io::start;
     using io::stop;
     ~evfd();
@@ -0,0 +1,29 @@
+#include "histogram.hpp"
+#include "log.hpp"
+
+/** Formats a duration in the most readable unit. */
+static std::string format_ns(double ns)
+{
+    if (ns < 1000) return fmt::format("{:.0f} ns", ns);
+    if (ns < 1000 * 1000) return fmt::format("{:.1f} µs", ns / 1000);
+    return fmt::format("{:.1f} ms", ns / 1000 / 1000);
+}
+
+std::string Log2Histogram::to_string() const
+{
+    if (n == 0) return "no samples";
+    std::string str = fmt::format("n={} avg={} max={} |",
+                                  n,
+                                  format_ns(static_cast<double>(sum.count()) / n),
+                                  format_ns(static_cast<double>(max_.count())));
+    for (size_t i = 0; i < BUCKETS; i++) {
+        if (buckets[i] == 0) continue;
+        // bucket i holds values below 2^i ns, the last one also everything above
+        bool last = i == BUCKETS - 1;
+        str += fmt::format(" {}{}: {}",
+                           last ? ">=" : "<",
+                           format_ns(static_cast<double>(1ULL << (last ? i - 1 : i))),
+                           buckets[i]);
+    }
+    return str;
+}
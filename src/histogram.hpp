@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+/**
+ * Histogram of durations with logarithmic (power of 2) buckets.
+ *
+ * Bucket `i` counts durations `d` with `2^(i-1) ns <= d < 2^i ns` (bucket 0 counts zero
+ * durations). Recording does not allocate, so it can be used while the scheduler is running.
+ */
+class Log2Histogram
+{
+public:
+    /** The last bucket also holds all durations above ~4.6 minutes. */
+    static constexpr size_t BUCKETS = 40;
+
+    void record(std::chrono::nanoseconds value)
+    {
+        // negative values may only result from clock imprecision, count them as zero
+        uint64_t v = value.count() > 0 ? value.count() : 0;
+        size_t bucket = v == 0 ? 0 : 64 - __builtin_clzll(v);
+        buckets[bucket < BUCKETS ? bucket : BUCKETS - 1]++;
+        n++;
+        sum += std::chrono::nanoseconds(v);
+        if (std::chrono::nanoseconds(v) > max_) max_ = std::chrono::nanoseconds(v);
+    }
+
+    [[nodiscard]] uint64_t count() const { return n; }
+    [[nodiscard]] std::chrono::nanoseconds max() const { return max_; }
+    [[nodiscard]] uint64_t bucket(size_t i) const { return buckets[i]; }
+
+    /** Formats summary statistics and all non-empty buckets on a single line. */
+    [[nodiscard]] std::string to_string() const;
+
+private:
+    std::array<uint64_t, BUCKETS> buckets{};
+    uint64_t n = 0;
+    std::chrono::nanoseconds sum{ 0 };
+    std::chrono::nanoseconds max_{ 0 };
+};
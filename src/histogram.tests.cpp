@@ -0,0 +1,47 @@
+#include "tests/acutest.h"
+
+#include "histogram.hpp"
+
+using namespace std::chrono;
+
+static void test_buckets()
+{
+    Log2Histogram h;
+    h.record(0ns);
+    h.record(1ns);
+    h.record(3ns);
+    h.record(1000ns);
+    h.record(1024ns);
+    h.record(-5ns); // counted as zero
+
+    TEST_CHECK(h.count() == 6);
+    TEST_CHECK(h.max() == 1024ns);
+    TEST_CHECK(h.bucket(0) == 2);
+    TEST_CHECK(h.bucket(1) == 1);  // [1, 2)
+    TEST_CHECK(h.bucket(2) == 1);  // [2, 4)
+    TEST_CHECK(h.bucket(10) == 1); // [512, 1024)
+    TEST_CHECK(h.bucket(11) == 1); // [1024, 2048)
+}
+
+static void test_overflow()
+{
+    Log2Histogram h;
+    h.record(hours(1));
+    TEST_CHECK(h.bucket(Log2Histogram::BUCKETS - 1) == 1);
+}
+
+static void test_to_string()
+{
+    Log2Histogram h;
+    TEST_CHECK(h.to_string() == "no samples");
+    h.record(1500ns);
+    h.record(2500ns);
+    TEST_CHECK(h.to_string() == "n=2 avg=2.0 µs max=2.5 µs | <2.0 µs: 1 <4.1 µs: 1");
+}
+
+TEST_LIST = {
+    { "buckets", test_buckets },
+    { "overflow", test_overflow },
+    { "to_string", test_to_string },
+    { nullptr, nullptr },
+};
@@ -38,8 +38,8 @@ public:
     cpu_set& operator &=(const cpu_set& o) { CPU_AND_S(size(), s, s, o.s); return *this; }
     cpu_set& operator ^=(const cpu_set& o) { CPU_XOR_S(size(), s, s, o.s); return *this; }
     cpu_set& operator |=(const cpu_set& o) { CPU_OR_S(size(), s, s, o.s); return *this; }
-    bool operator ==(cpu_set& o) { return CPU_EQUAL_S(size(), s, o.s); }
-    bool operator !=(cpu_set& o) { return !(o == *this); }
+    bool operator ==(const cpu_set& o) const { return CPU_EQUAL_S(size(), s, o.s); }
+    bool operator !=(const cpu_set& o) const { return !(o == *this); }
     unsigned count() const { return CPU_COUNT_S(size(), s); }
     size_t size() const { return CPU_ALLOC_SIZE(max_cpus); }
     cpu_set_t* ptr() const { return s; }
@@ -3,7 +3,9 @@
 #include "demos_scheduler.hpp"
 #include "lib/assert.hpp"
 #include "lib/check_lib.hpp"
+#include "power_policy/_cpuidle.hpp"
 #include "power_policy/_power_policy.hpp"
+#include "trace.hpp"
 #include <sched.h>
 #include "version.h"
 
@@ -16,6 +18,25 @@ static string pluralize(unsigned long count, const string &noun)
     return to_string(count) + " " + noun + (count != 1 ? "s" : "");
 }
 
+/** Parses a number of microseconds from the environment variable `name`. */
+static chrono::microseconds parse_env_microseconds(const char *name,
+                                                   const string &value,
+                                                   const string &expected = "")
+{
+    size_t end = 0;
+    unsigned long us = 0;
+    try {
+        us = stoul(value, &end);
+    } catch (const logic_error &) {
+        end = 0;
+    }
+    if (end == 0 || end != value.size() || value[0] == '-') {
+        throw runtime_error(string("Invalid value of ") + name + ": '" + value +
+                            "', expected a number of microseconds" + expected);
+    }
+    return chrono::microseconds(us);
+}
+
 static void reexec_via_systemd_run(int argc, char *argv[])
 {
     vector<const char *> args({ "systemd-run", "--scope", "-p", "Delegate=yes", "--user" });
@@ -68,7 +89,12 @@ static void print_help()
             "  [-M <MF_MESSAGE>]     print MF_MESSAGE to stdout at the beginning of each major frame\n"
             // TODO: shouldn't this be a config file option?
             "  [-t <TIMEOUT_MS>]     scheduler timeout (milliseconds); if all scheduled processes do not exit in\n"
-            "                         this interval, DEmOS stops them and exits\n"
+            "                         this interval, DEmOS stops them and exits; with 0, DEmOS exits right\n"
+            "                         after startup, which is useful to measure the startup time (the\n"
+            "                         duration of each startup phase is logged at the 'info' level)\n"
+            "  [-S <SOCKET_PATH>]    listen for control commands on a Unix socket; each command is a line,\n"
+            "                         supported commands are 'stats', 'pause', 'resume', 'drain', 'mode <NAME>'\n"
+            "                         and 'reload'\n"
             "  [-s]                  rerun itself via systemd-run to get access to unified cgroup hierarchy\n"
             "  [-d]                  dump config file without execution\n"
             "  [-V]                  print demos-sched version and exit\n"
@@ -79,7 +105,31 @@ static void print_help()
             "    use e.g. 'SPDLOG_LEVEL=debug,process=info'\n"
             "  DEMOS_PLAIN_LOG flag - if present, logs will not contain colors and time\n"
             "  DEMOS_FORCE_COLOR_LOG flag - if present, logger will always print colored logs, \n"
-            "    even when it is convinced that the attached terminal doesn't support it\n";
+            "    even when it is convinced that the attached terminal doesn't support it\n"
+            "Other environment variables:\n"
+            "  DEMOS_CGROUP_V1_FREEZER flag - if present, the cgroup v1 freezer hierarchy is used\n"
+            "    even when the kernel supports the cgroup v2 freezer\n"
+            "  DEMOS_SCHEDULE_LOG=<file> - write the executed schedule (process starts) to <file>\n"
+            "  DEMOS_TRACE_FILE=<file> - write a binary trace of all scheduling events to <file>\n"
+            "  DEMOS_ASYNC_CPUFREQ=[<cpus>] - write CPU frequencies (see -p) from a separate thread\n"
+            "    running on <cpus> (or on the DEmOS CPUs, if empty), so that the scheduler never\n"
+            "    waits for the frequency change; the thread runs at a real-time priority one level\n"
+            "    below DEmOS\n"
+            "  DEMOS_CPUFREQ_LEAD=<us>|auto - with the per_process and per_slice policies,\n"
+            "    set the frequency of the next window <us> microseconds (or the recent\n"
+            "    maximum of the measured transition latency, if 'auto') before it starts,\n"
+            "    instead of at its start\n"
+            "  DEMOS_CPUIDLE_LATENCY=<us> - disable idle states with exit latency over <us>\n"
+            "    microseconds on CPUs running SC partitions (deep idle states stay enabled on\n"
+            "    other CPUs and during BE partitions)\n"
+            "  DEMOS_ENERGY=[<sysfs>] - measure the energy consumed in each window using RAPL\n"
+            "    (powercap) or hwmon sensors from <sysfs> (or /sys, if empty), and report it\n"
+            "    per major frame, window, slice and partition on exit\n"
+            "Signals:\n"
+            "  SIGUSR1 - log histograms of timer lateness and window switch durations\n"
+            "    (also logged on exit)\n"
+            "  SIGUSR2 - switch to the next mode (see 'windows' in the config) at the end of the major frame\n"
+            "  SIGHUP - reload the configuration file (only with -c) at the end of the major frame\n";
     // clang-format on
 }
 
@@ -87,11 +137,12 @@ int main(int argc, char *argv[])
 {
     int opt;
     string config_file, config_str, window_sync_message, mf_sync_message, power_policy_name;
+    string control_socket_path;
     bool dump_config = false;
     bool systemd_run = false;
     std::optional<std::chrono::milliseconds> scheduler_timeout{};
 
-    while ((opt = getopt(argc, argv, "c:C:p:g:m:M:t:sdhV")) != -1) {
+    while ((opt = getopt(argc, argv, "c:C:p:g:m:M:t:S:sdhV")) != -1) {
         switch (opt) {
             case 'c': // config file path
                 config_file = optarg;
@@ -114,6 +165,9 @@ int main(int argc, char *argv[])
             case 't': // scheduler timeout
                 scheduler_timeout = std::chrono::milliseconds{ std::stoll(optarg) };
                 break;
+            case 'S': // control socket path
+                control_socket_path = optarg;
+                break;
             case 's': // rerun itself via systemd-run
                 systemd_run = true;
                 break;
@@ -147,6 +201,7 @@ int main(int argc, char *argv[])
         // === CONFIG LOADING ======================================================================
         // this print is useful to roughly measure startup times
         logger->debug("Starting DEmOS");
+        StartupReport startup_report;
         RUN_DEBUG(TRACE("Compiled in debug mode"));
         logger->trace("Loading configuration");
         Config config;
@@ -163,12 +218,25 @@ int main(int argc, char *argv[])
         logger->trace("Converting configuration to normal form");
         config.normalize();
         logger->debug("Configuration loaded");
+        startup_report.end_phase("config parse");
 
         if (dump_config) {
             cout << config.get() << endl;
             exit(0);
         }
 
+        // parsed before anything is set up, so that a typo does not leave processes behind
+        optional<chrono::microseconds> cpuidle_latency{};
+        if (const char *latency = getenv("DEMOS_CPUIDLE_LATENCY")) {
+            cpuidle_latency = parse_env_microseconds("DEMOS_CPUIDLE_LATENCY", latency);
+        }
+        const char *cpufreq_lead_env = getenv("DEMOS_CPUFREQ_LEAD");
+        optional<chrono::microseconds> cpufreq_lead{}; // nullopt = 'auto'
+        if (cpufreq_lead_env && string(cpufreq_lead_env) != "auto") {
+            cpufreq_lead =
+              parse_env_microseconds("DEMOS_CPUFREQ_LEAD", cpufreq_lead_env, " or 'auto'");
+        }
+
 
         // === ROOT CGROUP SETUP ===================================================================
         logger->trace("Creating top-level cgroups");
@@ -185,6 +253,9 @@ int main(int argc, char *argv[])
         ev::default_loop loop;
         // select power policy
         unique_ptr<PowerPolicy> pp = PowerPolicy::setup_power_policy(power_policy_name);
+        if (cpuidle_latency) {
+            pp = make_unique<PowerPolicy_CpuIdle>(move(pp), *cpuidle_latency);
+        }
 
 
         // === WINDOW & PARTITION INIT =============================================================
@@ -194,41 +265,61 @@ int main(int argc, char *argv[])
                             .loop = loop,
                             .power_policy = *pp };
         Partitions partitions;
-        Windows windows;
+        Modes modes;
         cpu_set demos_cpu; // cpuset DEmOS process itself runs on
-
-        // load demos cpuset, windows and partitions from config
-        config.create_scheduler_objects(cc, demos_cpu, windows, partitions);
-
-        logger->info("Parsed " + pluralize(partitions.size(), "partition") + " and " +
-                     pluralize(windows.size(), "window"));
-
-        if (partitions.empty() || windows.empty()) {
-            throw runtime_error("Need at least one partition in one window");
+        // read current CPU affinity mask
+        cpu_set allowed_cpus;
+        sched_getaffinity(0, allowed_cpus.size(), allowed_cpus.ptr());
+
+        // load demos cpuset, windows (grouped by mode) and partitions from config
+        config.create_scheduler_objects(cc, allowed_cpus, demos_cpu, modes, partitions);
+        startup_report.end_phase("cgroup setup");
+
+        for (auto &mode : modes) {
+            logger->info("Parsed " + pluralize(partitions.size(), "partition") + " and " +
+                         pluralize(mode.windows.size(), "window") +
+                         (modes.size() > 1 ? " in mode '" + mode.name + "'" : ""));
         }
 
 
         // === SCHEDULER SETUP =====================================================================
         // initialize the main scheduler instance
         DemosScheduler sched(
-          loop, move(partitions), move(windows), window_sync_message, mf_sync_message);
+          loop, move(partitions), move(modes), window_sync_message, mf_sync_message);
         // this spawns the underlying system processes
-        sched.setup();
+        sched.setup(move(startup_report));
+        if (!control_socket_path.empty()) {
+            sched.enable_control_socket(control_socket_path);
+        }
+        if (!config_file.empty()) {
+            sched.enable_reload(config_file, cc, allowed_cpus);
+        }
+        if (const char *sysfs_root = getenv("DEMOS_ENERGY")) {
+            sched.enable_energy_accounting(*sysfs_root ? sysfs_root : "/sys");
+        }
 
         // configure linux scheduler - set the highest possible priority for demos
         // must be called after child process creation (in `sched.setup()`),
-        //  as we don't want children to inherit RT priority
+        //  as we don't want children to inherit RT priority; processes spawned later
+        //  (on restart or config reload) are reset to the default policy by SCHED_RESET_ON_FORK
         struct sched_param sp = { .sched_priority = 99 };
-        if (sched_setscheduler(0, SCHED_FIFO, &sp) == -1) {
+        if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &sp) == -1) {
             logger->warn("Running DEmOS without real-time priority, consider running as root");
         }
 
         // configure CPU affinity for DEmOS
+        Process::set_spawn_affinity(allowed_cpus);
         if (sched_setaffinity(0, demos_cpu.size(), demos_cpu.ptr()) == -1) {
             logger->warn("Failed to set the CPU affinity for DEmOS");
         }
         logger->debug("DEmOS is running on CPUs '{}'", demos_cpu.as_list());
 
+        // started after the priority of DEmOS is set, the writer thread runs one level below it
+        if (const char *writer_cpus = getenv("DEMOS_ASYNC_CPUFREQ")) {
+            pp->start_async_frequency_writes(*writer_cpus ? cpu_set(writer_cpus) : demos_cpu);
+        }
+        if (cpufreq_lead_env) pp->set_frequency_lead_time(cpufreq_lead);
+
         // TODO: document that DEmOS cannot reliably schedule under 1 millisecond,
         //  because libev doesn't guarantee it
 
@@ -239,6 +330,13 @@ int main(int argc, char *argv[])
         //  they're not empty; catch the exception here, attempt to cleanup (sched.initiate_shutdown),
         //  then rethrow (if it fails, throw immediately)
         scheduler_timeout ? sched.run(scheduler_timeout.value()) : sched.run();
+        // write out the trace and schedule log (if enabled)
+        schedule_trace.finish();
+        if (uint64_t dropped = schedule_trace.get_dropped()) {
+            logger->warn("Schedule trace dropped '{}' events, as they were recorded faster "
+                         "than they could be written",
+                         dropped);
+        }
 
     } catch (const exception &e) {
         log_exception(e);
@@ -1,34 +1,123 @@
 #include "majorframe.hpp"
 #include "log.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <iostream>
+#include <lib/assert.hpp>
 
 using namespace std;
 
 MajorFrame::MajorFrame(ev::loop_ref loop,
-                       Windows &&windows_,
+                       Modes &&modes_,
                        string window_sync_message_,
                        string mf_sync_message_)
-    : timer(loop)
-    , windows(std::move(windows_))
-    , current_win(windows.begin())
+    : dispatcher(loop)
+    // the window timer slot must be added before slice timers, so that
+    //  Window::stop is called before a slice timer expiring at the same time
+    , timer_slot(dispatcher.add_slot([this] { timeout_cb(); }))
+    , prepare_slot(dispatcher.add_slot([this] { prepare_cb(); }))
     , window_sync_message(std::move(window_sync_message_))
     , mf_sync_message(std::move(mf_sync_message_))
 {
-    timer.set([this] { timeout_cb(); });
+    compile_modes(std::move(modes_));
+    select_mode(modes.front());
+}
+
+void MajorFrame::compile_modes(Modes &&new_modes)
+{
+    ASSERT(!new_modes.empty());
+    for (auto &mode : new_modes) {
+        auto &m = modes.emplace_back(CompiledMode{ std::move(mode) });
+        compile_schedule(m);
+        link_continuing_slices(m.mode.windows);
+    }
+    if (energy_meter) prepare_energy_accounting();
+}
+
+void MajorFrame::select_mode(CompiledMode &m)
+{
+    current_mode = &m;
+    current_entry = 0;
+    current_win = m.schedule.empty() ? nullptr : m.schedule[0].window;
+}
+
+void MajorFrame::replace_modes(Modes &&new_modes)
+{
+    ASSERT(!running);
+    string mode_name = current_mode->mode.name;
+    next_mode = nullptr;
+    // the old windows must be destroyed before their budget timer slots are reused
+    modes.clear();
+    dispatcher.remove_slots(prepare_slot + 1);
+    compile_modes(std::move(new_modes));
+    // stay in the current mode if it still exists
+    auto it = std::find_if(
+      modes.begin(), modes.end(), [&](auto &m) { return m.mode.name == mode_name; });
+    select_mode(it != modes.end() ? *it : modes.front());
+}
+
+void MajorFrame::compile_schedule(CompiledMode &m)
+{
+    m.schedule.reserve(m.mode.windows.size());
+    for (auto &w : m.mode.windows) {
+        m.schedule.push_back({ m.mf_length, &w, {}, {}, 0, 0, vector<double>(w.slices.size()), {} });
+        m.mf_length += w.length;
+        for (auto &s : w.slices) {
+            s.bind_timer(dispatcher);
+        }
+    }
+}
+
+/**
+ * For each slice, finds a slice in the next window running on the same CPUs.
+ * If the partition running at the end of a window continues in such slice,
+ * its process does not have to be frozen and then immediately thawed again.
+ */
+void MajorFrame::link_continuing_slices(Windows &windows)
+{
+    for (auto win = windows.begin(); win != windows.end(); win++) {
+        auto next_win = std::next(win) == windows.end() ? windows.begin() : std::next(win);
+        for (auto &s : win->slices) {
+            for (auto &next_s : next_win->slices) {
+                if (next_s.cpus != s.cpus) continue;
+                bool shared_partition = (s.sc && (s.sc == next_s.sc || s.sc == next_s.be)) ||
+                                        (s.be && (s.be == next_s.sc || s.be == next_s.be));
+                if (shared_partition) s.set_successor(next_s);
+                // slices in a window do not overlap, there is no other slice with the same CPUs
+                break;
+            }
+        }
+    }
 }
 
 void MajorFrame::move_to_next_window()
 {
-    if (++current_win == windows.end()) {
-        current_win = windows.begin();
+    if (++current_entry == current_mode->schedule.size()) {
+        current_entry = 0;
+        mf_start_time += current_mode->mf_length;
+        mf_counter++;
+        if (next_mode) {
+            current_mode = next_mode;
+            next_mode = nullptr;
+        }
     }
+    current_win = current_mode->schedule[current_entry].window;
 }
 
-// TODO: add optimization to keep processes running if their
-//  partition immediately continues in the next window
 void MajorFrame::start(time_point current_time)
 {
-    if (!mf_sync_message.empty() && current_win == windows.begin()) {
+    running = true;
+    start_window(current_time);
+    // the energy consumed while the scheduler was stopped is not attributed to any window
+    if (energy_meter) energy_meter->sample(chrono::steady_clock::now());
+}
+
+void MajorFrame::start_window(time_point current_time)
+{
+    if (current_entry == 0) {
+        mf_start_time = current_time;
+    }
+    if (!mf_sync_message.empty() && current_entry == 0) {
         cout << mf_sync_message << endl;
         // flush to force correct synchronization with other stdout prints from scheduled programs
         cout.flush();
@@ -37,41 +126,274 @@ void MajorFrame::start(time_point current_time)
         cout << window_sync_message << endl;
         cout.flush();
     }
+    auto &schedule = current_mode->schedule;
+    timeout = current_entry + 1 == schedule.size()
+                ? mf_start_time + current_mode->mf_length
+                : mf_start_time + schedule[current_entry + 1].offset;
+    schedule_trace.record(TraceEvent::window_start, current_time, current_entry);
     // this call make take 100-200 µs due to the blocking
     //  cpufreq write in case frequency is changed here
-    current_win->start(current_time);
-    timeout = current_time + current_win->length;
-    timer.start(timeout);
+    current_win->start(current_time,
+                       { timeout, mf_counter, static_cast<uint32_t>(current_entry) });
+    dispatcher.arm(timer_slot, timeout);
+    // let the power policy switch the frequency for the next window ahead of time;
+    //  if the window is too short for that, it is switched when the next window starts
+    auto lead = current_win->get_prepare_lead_time();
+    if (lead > 0ns && timeout - lead > current_time) {
+        dispatcher.arm(prepare_slot, timeout - lead);
+    }
 }
 
 void MajorFrame::stop(time_point current_time)
 {
-    timer.stop();
+    if (!running) return;
+    running = false;
+    stop_cb = nullptr;
+    dispatcher.disarm(timer_slot);
+    dispatcher.disarm(prepare_slot);
     current_win->stop(current_time);
+    schedule_trace.record(TraceEvent::window_stop, current_time, current_entry);
+    if (energy_meter) account_energy(current_mode->schedule[current_entry]);
 }
 
 void MajorFrame::timeout_cb()
 {
-    current_win->stop(timeout);
-    if (!current_win->has_sc_finished()) {
+    auto switch_start = chrono::steady_clock::now();
+    Window &prev_win = *current_win;
+    ScheduleEntry &prev_entry = current_mode->schedule[current_entry];
+    bool mf_end = current_entry + 1 == current_mode->schedule.size();
+    bool stopping = stop_cb && mf_end;
+    bool switching_mode = next_mode && mf_end;
+    // processes can only be parked if we know that the successor slice runs next
+    prev_win.stop(timeout, !stopping && !switching_mode);
+    schedule_trace.record(TraceEvent::window_stop, timeout, current_entry);
+    windows_executed++;
+    if (!prev_win.has_sc_finished()) {
+        sc_overruns++;
         logger->warn("Window ended before all SC partitions finished");
     }
     move_to_next_window();
-    start(timeout);
+    if (stopping) {
+        running = false;
+        auto cb = std::move(stop_cb);
+        stop_cb = nullptr;
+        if (energy_meter) account_energy(prev_entry);
+        cb();
+        return;
+    }
+    start_window(timeout);
+    // processes that did not continue in the new window are frozen only now
+    prev_win.finish_parking();
+    auto &entry = current_mode->schedule[current_entry];
+    entry.lateness.record(switch_start - timeout);
+    entry.switch_duration.record(chrono::steady_clock::now() - switch_start);
+    // the sensors are read only after the switch, so that it is not delayed
+    if (energy_meter) account_energy(prev_entry);
+    if (switching_mode) {
+        logger->info("Switched to mode '{}'", current_mode->mode.name);
+    }
 }
 
-const cpu_set *MajorFrame::find_widest_cpu_set(Partition &partition)
+void MajorFrame::prepare_cb()
 {
-    Partition *p = &partition;
-    const cpu_set *best_found = nullptr;
-    for (auto &w : windows) {
-        for (auto &s : w.slices) {
-            if (s.sc != p && s.be != p) continue; // not our partition
-            // if we haven't found any cpuset yet, or the compared cpuset has more cores, store it
-            if (!best_found || s.cpus.count() > best_found->count()) {
-                best_found = &s.cpus;
+    bool mf_end = current_entry + 1 == current_mode->schedule.size();
+    if (mf_end && stop_cb) return; // no next window
+    // mirrors `move_to_next_window`; a mode switch requested after this point
+    //  is not reflected, the power policy then sets the frequency at the window start
+    const CompiledMode *mode = mf_end && next_mode ? next_mode : current_mode;
+    mode->schedule[mf_end ? 0 : current_entry + 1].window->prepare();
+}
+
+bool MajorFrame::switch_mode(const std::string &name)
+{
+    for (auto &m : modes) {
+        if (m.mode.name != name) continue;
+        if (running) {
+            // switching back to the current mode cancels a pending switch
+            next_mode = &m == current_mode ? nullptr : &m;
+        } else {
+            // not running, so we're at the start of a major frame (see `stop_at_mf_end`)
+            select_mode(m);
+        }
+        return true;
+    }
+    return false;
+}
+
+void MajorFrame::switch_to_next_mode()
+{
+    const CompiledMode *from = next_mode ? next_mode : current_mode;
+    auto it = modes.begin();
+    while (&*it != from) it++;
+    if (++it == modes.end()) it = modes.begin();
+    switch_mode(it->mode.name);
+}
+
+void MajorFrame::stop_at_mf_end(std::function<void()> stopped_cb)
+{
+    stop_cb = std::move(stopped_cb);
+}
+
+void MajorFrame::log_timing_stats(spdlog::level::level_enum level) const
+{
+    for (auto &m : modes) {
+        // only show the mode name if there are multiple modes
+        std::string prefix = modes.size() > 1 ? "Mode '" + m.mode.name + "' window" : "Window";
+        for (size_t i = 0; i < m.schedule.size(); i++) {
+            auto &entry = m.schedule[i];
+            logger->log(level, "{} #{} start lateness: {}", prefix, i, entry.lateness.to_string());
+            logger->log(
+              level, "{} #{} switch duration: {}", prefix, i, entry.switch_duration.to_string());
+            for (auto &s : entry.window->slices) {
+                logger->log(level,
+                            "{} #{} slice '{}' budget timer lateness: {}",
+                            prefix,
+                            i,
+                            s.cpus.as_list(),
+                            s.get_timer_lateness().to_string());
+            }
+        }
+    }
+}
+
+/** Total time the processes of `part` were scheduled to run. */
+static chrono::nanoseconds consumed_time(const Partition &part)
+{
+    chrono::nanoseconds consumed{ 0 };
+    for (auto &proc : part.processes) {
+        consumed += proc.get_run_stats().consumed;
+    }
+    return consumed;
+}
+
+void MajorFrame::enable_energy_accounting(const std::filesystem::path &sysfs_root)
+{
+    energy_meter.emplace(sysfs_root);
+    if (!energy_meter->has_sensors()) {
+        logger->warn("No energy sensors found in '{}', energy accounting disabled",
+                     sysfs_root.string());
+        energy_meter.reset();
+        return;
+    }
+    logger->debug("Measuring energy using '{}'", fmt::join(energy_meter->sensor_names(), "', '"));
+    prepare_energy_accounting();
+}
+
+/**
+ * Links each schedule entry to the partitions running in it, so that no lookup
+ * (and allocation) is needed while the scheduler runs.
+ */
+void MajorFrame::prepare_energy_accounting()
+{
+    for (auto &m : modes) {
+        for (auto &entry : m.schedule) {
+            entry.energy_shares.clear();
+            size_t i = 0;
+            for (auto &s : entry.window->slices) {
+                for (const Partition *p : { s.sc, s.be }) {
+                    if (!p) continue;
+                    auto &pe = partition_energy[p->get_name()];
+                    // after a reload, the partition may have a different set of processes
+                    pe.last_consumed = consumed_time(*p);
+                    entry.energy_shares.push_back({ i, p, &pe });
+                }
+                i++;
+            }
+        }
+    }
+}
+
+/**
+ * Attributes the energy consumed since the previous sample to `entry`, and splits it between
+ * its slices and partitions in proportion to the time consumed by each partition.
+ */
+void MajorFrame::account_energy(ScheduleEntry &entry)
+{
+    double energy_uj = energy_meter->sample(chrono::steady_clock::now());
+    entry.energy_uj += energy_uj;
+    entry.energy_samples++;
+
+    chrono::nanoseconds total{ 0 };
+    for (auto &share : entry.energy_shares) {
+        auto consumed = consumed_time(*share.partition);
+        // a partition running in multiple slices is only counted once
+        share.energy->window_consumed += consumed - share.energy->last_consumed;
+        total += consumed - share.energy->last_consumed;
+        share.energy->last_consumed = consumed;
+    }
+    for (auto &share : entry.energy_shares) {
+        // nothing ran in the window, leave the energy unattributed
+        if (total == 0ns) break;
+        double part_uj = energy_uj * static_cast<double>(share.energy->window_consumed.count()) /
+                         static_cast<double>(total.count());
+        share.energy->energy_uj += part_uj;
+        entry.slice_energy_uj[share.slice] += part_uj;
+        share.energy->window_consumed = 0ns;
+    }
+}
+
+void MajorFrame::log_energy_stats() const
+{
+    if (!energy_meter) return;
+    double total_uj = 0;
+    for (auto &m : modes) {
+        // only show the mode name if there are multiple modes
+        std::string prefix = modes.size() > 1 ? "Mode '" + m.mode.name + "' window" : "Window";
+        double mf_uj = 0;
+        for (size_t i = 0; i < m.schedule.size(); i++) {
+            auto &entry = m.schedule[i];
+            total_uj += entry.energy_uj;
+            if (entry.energy_samples == 0) continue;
+            auto samples = static_cast<double>(entry.energy_samples);
+            mf_uj += entry.energy_uj / samples;
+            logger->debug(
+              "{} #{} energy: {:.6f} J per execution", prefix, i, entry.energy_uj / samples / 1e6);
+            size_t j = 0;
+            for (auto &s : entry.window->slices) {
+                logger->debug("{} #{} slice '{}' energy: {:.6f} J per execution",
+                              prefix,
+                              i,
+                              s.cpus.as_list(),
+                              entry.slice_energy_uj[j++] / samples / 1e6);
+            }
+        }
+        logger->info("Energy consumed{}: {:.6f} J per major frame",
+                     modes.size() > 1 ? " in mode '" + m.mode.name + "'" : "",
+                     mf_uj / 1e6);
+    }
+    logger->info("Total energy consumed by scheduled windows: {:.3f} J", total_uj / 1e6);
+    // sorted by name, for stable output
+    std::vector<std::pair<std::string, double>> partitions;
+    for (auto &[name, pe] : partition_energy) partitions.emplace_back(name, pe.energy_uj);
+    std::sort(partitions.begin(), partitions.end());
+    for (auto &[name, energy_uj] : partitions) {
+        logger->info("Partition '{}' energy: {:.3f} J ({:.1f} %)",
+                     name,
+                     energy_uj / 1e6,
+                     total_uj > 0 ? 100 * energy_uj / total_uj : 0.0);
+    }
+}
+
+std::unordered_map<const Partition *, const cpu_set *> MajorFrame::find_widest_cpu_sets() const
+{
+    // single pass over all slices, instead of one pass for each partition
+    std::unordered_map<const Partition *, const cpu_set *> widest;
+    auto update = [&](const Partition *p, const cpu_set &cpus) {
+        if (!p) return;
+        // if we haven't found any cpuset yet, or the compared cpuset has more cores,
+        //  store it
+        auto &best_found = widest[p];
+        if (!best_found || cpus.count() > best_found->count()) {
+            best_found = &cpus;
+        }
+    };
+    for (auto &m : modes) {
+        for (auto &w : m.mode.windows) {
+            for (auto &s : w.slices) {
+                update(s.sc, s.cpus);
+                update(s.be, s.cpus);
             }
         }
     }
-    return best_found;
+    return widest;
 }
@@ -1,9 +1,14 @@
 #pragma once
 
-#include "timerfd.hpp"
+#include "dispatcher.hpp"
+#include "energy_meter.hpp"
 #include "window.hpp"
 #include <ev++.h>
+#include <filesystem>
 #include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
 
 using time_point = std::chrono::steady_clock::time_point;
 
@@ -11,42 +16,174 @@ using time_point = std::chrono::steady_clock::time_point;
  * Container for all time windows.
  *
  * Switches between windows in a cycle (in order, starting from the first one).
+ *
+ * The windows are grouped into modes; windows from a single mode are executed at a time,
+ * starting with the first mode. The mode can be switched at the end of a major frame.
+ *
+ * On construction, the windows of each mode are compiled into a flat schedule table with
+ * the offset of each window from the start of the major frame, and the budget
+ * timers of all slices are bound to a single timer dispatcher shared with the
+ * window timer. Switching the mode then only changes the active table.
  */
 class MajorFrame
 {
 public:
     /**
      * @param loop - main ev loop
-     * @param windows - scheduled windows
+     * @param modes - scheduled windows, grouped by mode; must not be empty
      * @param window_sync_message - if not empty, this message is printed to stdout
      *  at the beginning of each window
      * @param mf_sync_message - if not empty, this message is printed to stdout
      *  at the beginning of each major frame
      */
     MajorFrame(ev::loop_ref loop,
-               Windows &&windows,
+               Modes &&modes,
                std::string window_sync_message,
                std::string mf_sync_message);
 
+    // the schedule tables point into `modes`
+    MajorFrame(const MajorFrame &) = delete;
+    const MajorFrame &operator=(const MajorFrame &) = delete;
+
+    /**
+     * Starts the window scheduler. After `stop_at_mf_end(...)`, this resumes scheduling
+     * with a new major frame.
+     */
     void start(time_point start_time);
     /** Stops the window scheduler. If not running, this is a noop. */
     void stop(time_point current_time);
+    /**
+     * Stops the window scheduler at the end of the current major frame
+     * and then calls `stopped_cb`. Passing nullptr cancels a pending request.
+     */
+    void stop_at_mf_end(std::function<void()> stopped_cb);
+    [[nodiscard]] bool is_running() const { return running; }
+    [[nodiscard]] bool is_stop_pending() const { return stop_cb != nullptr; }
+
+    [[nodiscard]] uint64_t get_windows_executed() const { return windows_executed; }
+    /** Number of windows which ended before all their SC partitions finished. */
+    [[nodiscard]] uint64_t get_sc_overruns() const { return sc_overruns; }
+    [[nodiscard]] uint64_t get_mf_counter() const { return mf_counter; }
+
+    /**
+     * Switches to the mode with given name at the end of the current major frame
+     * (or immediately, if the scheduler is not running).
+     * Returns false if there is no such mode.
+     */
+    bool switch_mode(const std::string &name);
+    /** Like `switch_mode`, but selects the mode following the current one in config order. */
+    void switch_to_next_mode();
+    [[nodiscard]] const std::string &get_mode_name() const { return current_mode->mode.name; }
+
+    /**
+     * Replaces all windows with `new_modes`, e.g. after the configuration is reloaded.
+     * Must only be called while the scheduler is stopped, and not from a timer callback.
+     * The current mode is kept if `new_modes` contain a mode of the same name.
+     */
+    void replace_modes(Modes &&new_modes);
+
+    /**
+     * For each partition, compares cpu_sets of all slices containing it and returns
+     * pointer to the largest one. Partitions not contained in any slice are missing
+     * from the result.
+     */
+    std::unordered_map<const Partition *, const cpu_set *> find_widest_cpu_sets() const;
+
+    /**
+     * Logs histograms of timer lateness (for each window boundary and each slice)
+     * and of the duration of window switches.
+     */
+    void log_timing_stats(spdlog::level::level_enum level) const;
 
     /**
-     * Compares cpu_sets of all slices containing given partition
-     * and returns pointer to the largest one, or nullptr if no such slice exists.
+     * Measures the energy consumed in each window using the sensors found under
+     * `sysfs_root` (see `EnergyMeter`). The sensors are read once per window switch, right
+     * after the next window is started, so the measured energy of a window also includes
+     * the switch to the next one. The energy of a window is split between the partitions
+     * running in it in proportion to the time they were scheduled.
      */
-    const cpu_set *find_widest_cpu_set(Partition &partition);
+    void enable_energy_accounting(const std::filesystem::path &sysfs_root);
+    /** Logs the energy consumed per major frame, window, slice and partition. */
+    void log_energy_stats() const;
 
 private:
-    ev::timerfd timer;
-    Windows windows;
-    Windows::iterator current_win;
+    /** Energy attributed to a partition, kept across configuration reloads. */
+    struct PartitionEnergy
+    {
+        double energy_uj = 0;
+        /** Time consumed by the partition's processes when the energy was last attributed. */
+        std::chrono::nanoseconds last_consumed{ 0 };
+        /** Time consumed in the window being accounted. */
+        std::chrono::nanoseconds window_consumed{ 0 };
+    };
+
+    struct EnergyShare
+    {
+        /** Index of the slice in `ScheduleEntry::window->slices`. */
+        size_t slice;
+        const Partition *partition;
+        PartitionEnergy *energy;
+    };
+
+    struct ScheduleEntry
+    {
+        /** Window start, relative to the start of the major frame. */
+        std::chrono::nanoseconds offset;
+        Window *window;
+        /** How late the switch to this window started. */
+        Log2Histogram lateness{};
+        /** How long it took to stop the previous window and start this one. */
+        Log2Histogram switch_duration{};
+        /** Energy consumed in this window (summed over all its executions), in µJ. */
+        double energy_uj = 0;
+        /** Number of executions of this window included in `energy_uj`. */
+        uint64_t energy_samples = 0;
+        /** Part of `energy_uj` attributed to each slice, in the order of `window->slices`. */
+        std::vector<double> slice_energy_uj{};
+        /** Partitions running in the window, see `prepare_energy_accounting`. */
+        std::vector<EnergyShare> energy_shares{};
+    };
+
+    struct CompiledMode
+    {
+        Mode mode;
+        std::vector<ScheduleEntry> schedule{};
+        std::chrono::nanoseconds mf_length{ 0 };
+    };
+
+    TimerDispatcher dispatcher;
+    TimerDispatcher::Slot timer_slot;
+    /** Fires `Window::get_prepare_lead_time()` before the end of the current window. */
+    TimerDispatcher::Slot prepare_slot;
+    std::list<CompiledMode> modes{};
+    CompiledMode *current_mode = nullptr;
+    /** Mode to switch to at the end of the current major frame. */
+    CompiledMode *next_mode = nullptr;
+    size_t current_entry = 0;
+    Window *current_win = nullptr;
+    time_point mf_start_time = time_point::min();
+    /** Number of completed major frames. */
+    uint64_t mf_counter = 0;
     // will be overwritten in start(...), value is not important
     time_point timeout = time_point::min();
+    bool running = false;
+    std::function<void()> stop_cb = nullptr;
+    uint64_t windows_executed = 0;
+    uint64_t sc_overruns = 0;
     const std::string window_sync_message;
     const std::string mf_sync_message;
+    std::optional<EnergyMeter> energy_meter{};
+    /** Keyed by partition name. */
+    std::unordered_map<std::string, PartitionEnergy> partition_energy{};
 
+    void compile_modes(Modes &&new_modes);
+    void compile_schedule(CompiledMode &m);
+    void select_mode(CompiledMode &m);
     void move_to_next_window();
+    void start_window(time_point current_time);
+    static void link_continuing_slices(Windows &windows);
     void timeout_cb();
+    void prepare_cb();
+    void prepare_energy_accounting();
+    void account_energy(ScheduleEntry &entry);
 };
@@ -1,5 +1,6 @@
 #include "partition.hpp"
 #include "lib/assert.hpp"
+#include "log.hpp"
 #include <algorithm>
 
 using namespace std;
@@ -7,18 +8,23 @@ using namespace std;
 Partition::Partition(Cgroup &freezer_parent,
                      Cgroup &cpuset_parent,
                      Cgroup &events_parent,
-                     const string &name)
+                     const string &name,
+                     const string &cgroup_prefix)
     : name(name)
     , current_proc(nullptr)
-    , cgc(cpuset_parent, name)
-    , cgf(freezer_parent, name)
-    , cge(events_parent, name)
+    , cgc(cpuset_parent, cgroup_prefix + name)
+    // empty freezer parent means that the cgroup v2 freezer is used instead
+    , cgf(freezer_parent.get_path().empty() ? Cgroup()
+                                            : Cgroup(freezer_parent, cgroup_prefix + name))
+    , cge(events_parent, cgroup_prefix + name)
 {}
 
 void Partition::kill_all()
 {
+    // a single write kills the processes from all process cgroups of this partition
+    bool cgroup_killed = cge.kill_tree();
     for (auto &p : processes) {
-        p.kill();
+        p.kill(cgroup_killed);
     }
 }
 
@@ -28,8 +34,20 @@ void Partition::add_process(ev::loop_ref loop,
                             chrono::milliseconds budget,
                             chrono::milliseconds budget_jitter,
                             std::optional<CpuFrequencyHz> req_freq,
-                            bool has_initialization)
+                            bool has_initialization,
+                            bool futex_yield)
 {
+    auto prev = find_if(previous_processes.begin(), previous_processes.end(), [&](Process &p) {
+        return p.is_spawned() &&
+               p.has_definition(argv, working_dir, req_freq, has_initialization, futex_yield);
+    });
+    if (prev != previous_processes.end()) {
+        prev->set_budget(budget, budget_jitter);
+        processes.splice(processes.end(), previous_processes, prev);
+        current_proc = processes.begin();
+        empty = false;
+        return;
+    }
     processes.emplace_back(loop,
                            "proc" + to_string(proc_count),
                            *this,
@@ -38,7 +56,8 @@ void Partition::add_process(ev::loop_ref loop,
                            budget,
                            budget_jitter,
                            req_freq,
-                           has_initialization);
+                           has_initialization,
+                           futex_yield);
     proc_count++;
     current_proc = processes.begin();
     empty = false;
@@ -48,11 +67,64 @@ void Partition::add_process(ev::loop_ref loop,
 void Partition::create_processes()
 {
     for (auto &p : processes) {
+        if (p.get_pid() != -1) continue; // already spawned
         p.exec();
-        cgc.add_process(p.get_pid());
     }
 }
 
+void Partition::attach_processes()
+{
+    for (auto &p : processes) {
+        p.attach(cgc);
+    }
+}
+
+void Partition::begin_update()
+{
+    ASSERT(previous_processes.empty());
+    previous_processes.splice(previous_processes.end(), processes);
+}
+
+void Partition::finish_update()
+{
+    size_t new_count = 0;
+    for (auto &p : processes) {
+        if (p.get_pid() == -1) new_count++;
+    }
+    logger->debug("Partition '{}': {} processes kept, {} added, {} removed",
+                 name,
+                 processes.size() - new_count,
+                 new_count,
+                 previous_processes.size());
+    for (auto &p : previous_processes) {
+        p.kill();
+    }
+    retired_processes.splice(retired_processes.end(), previous_processes);
+    current_proc = processes.begin();
+    empty = processes.empty();
+
+    // the heap may refer to the removed processes; it is filled again in `reset(...)`
+    stride_heap.clear();
+    stride_heap_size = 0;
+    stride_active = false;
+    // preallocated, so that `reset(...)` does not allocate while the scheduler runs
+    stride_heap.reserve(processes.size());
+    // new processes start at the lowest pass of the kept ones, so that they do not
+    //  monopolize the partition until they catch up
+    uint64_t min_pass = UINT64_MAX;
+    for (auto &p : processes) {
+        if (p.get_pid() != -1) min_pass = min(min_pass, p.get_pass());
+    }
+    for (auto &p : processes) {
+        if (p.get_pid() == -1) p.set_pass(min_pass == UINT64_MAX ? 0 : min_pass);
+    }
+}
+
+void Partition::prune_retired_processes()
+{
+    retired_processes.remove_if([](Process &p) { return !p.is_spawned(); });
+}
+
 void Partition::reset(bool move_to_first_proc,
                       const cpu_set &cpus,
                       const function<void(Process &)> &process_completion_cb)
@@ -70,6 +142,17 @@ void Partition::reset(bool move_to_first_proc,
     if (move_to_first_proc) {
         current_proc = processes.begin();
     }
+
+    // SC partitions always run their processes in order
+    stride_active = stride_scheduling && !move_to_first_proc;
+    if (stride_active) {
+        stride_heap.clear();
+        for (auto &p : processes) {
+            if (p.is_pending()) stride_heap.push_back(&p);
+        }
+        std::make_heap(stride_heap.begin(), stride_heap.end(), stride_order);
+        stride_heap_size = stride_heap.size();
+    }
 }
 
 void Partition::disconnect()
@@ -92,6 +175,7 @@ void Partition::move_to_next_proc()
 
 Process *Partition::seek_pending_process()
 {
+    if (stride_active) return seek_stride_process([](const Process &) { return false; });
     for (size_t i = 0; i < processes.size(); i++) {
         if (current_proc->is_pending()) return &*current_proc;
         move_to_next_proc();
@@ -127,6 +211,11 @@ void Partition::set_process_exit_cb(ExitCb new_exit_cb)
 
 void Partition::proc_exit_cb(Process &proc)
 {
+    if (proc.is_restarting()) {
+        // killed by its overrun policy, the partition does not become empty
+        proc.respawn(cgc);
+        return;
+    }
     empty = true;
     for (auto &p : processes) {
         if (p.is_spawned()) empty = false;
@@ -3,9 +3,11 @@
 #include "cgroup.hpp"
 #include "lib/cpu_set.hpp"
 #include "process.hpp"
+#include <algorithm>
 #include <chrono>
 #include <functional>
 #include <list>
+#include <vector>
 
 class Partition;
 
@@ -22,6 +24,11 @@ using Processes = std::list<Process>;
  * process, even if not all processes had chance to run in the last window;
  * in best-effort partitions, execution is continued from last unfinished process.
  *
+ * Alternatively, BE partitions can use stride scheduling (see `set_stride_scheduling`):
+ * the pending process with the lowest pass (see `Process::get_pass()`) runs next, so
+ * the processes get their turns in proportion to their weights. The pending processes
+ * are kept in a binary heap, so the selection takes O(log n) instead of a linear scan.
+ *
  * TODO: split off SCPartition and BEPartition as subclasses
  */
 class Partition
@@ -40,6 +47,19 @@ private:
      *  Cached property to speed up exit checks in PartitionManager. */
     bool empty = true;
 
+    /** If true, BE scheduling uses the stride scheduler (see above). */
+    bool stride_scheduling = false;
+    /** True if the partition was reset for BE scheduling with the stride scheduler. */
+    bool stride_active = false;
+    /**
+     * Processes that were pending at the last `reset(...)`. The first `stride_heap_size`
+     * are a min-heap (by `stride_order`); the rest were returned by `seek_stride_process`
+     * and are kept out of the heap while their pass may change. Completed processes are
+     * dropped lazily.
+     */
+    std::vector<Process *> stride_heap{};
+    size_t stride_heap_size = 0;
+
     CompletionCb _completed_cb = nullptr;
     // invoked when a process in this partition exits
     ExitCb _proc_exit_cb = nullptr;
@@ -47,26 +67,48 @@ private:
 public:
     // cgf and cge are read by Process constructor in process.cpp
     // both are only used to create child cgroups, don't need the specialized subclasses
+    // cgf is empty when the cgroup v2 freezer is used (see `uses_v1_freezer()`)
     Cgroup cgf;
     Cgroup cge;
     // public, to allow iterating over all processes from outside (but should not be mutated)
     // Note: `processes` MUST be located after all cgroups (cgc, cgf, cge) - Process destructors
     //  must run before the cgroup destructors to cleanup child cgroups in correct order
     Processes processes{};
+
+private:
+    // like `processes`, these must be located after all cgroups
+    /** Processes from before `begin_update()` that were not reused (yet). */
+    Processes previous_processes{};
+    /** Processes removed by `finish_update()`, kept until they exit. */
+    Processes retired_processes{};
+
+public:
     /** Current cpu_set the partition is running under. */
     const cpu_set& current_cpus() { return cgc.get_cpus(); }
+    /** Sets the cpu_set without resetting the partition (see `reset(...)`). */
+    void set_cpus(const cpu_set &cpus) { cgc.set_cpus(cpus); }
 
 public:
+    /**
+     * @param cgroup_prefix - prepended to `name` in the names of the partition cgroups,
+     *  so that scratch partitions do not clash with the current ones
+     *  (see `Config::check_scheduler_objects`)
+     */
     Partition(Cgroup &freezer_parent,
               Cgroup &cpuset_parent,
               Cgroup &events_parent,
-              const std::string &name = "");
+              const std::string &name = "",
+              const std::string &cgroup_prefix = "");
 
     /**
      * Adds a new process to the partition,
      * but doesn't spawn a matching system process.
      *
      * `create_processes()` must be explicitly called after all processes are added.
+     *
+     * Between `begin_update()` and `finish_update()`, a running process with the same
+     * definition (see `Process::has_definition`) is reused instead, only its budget
+     * is updated.
      */
     void add_process(ev::loop_ref loop,
                      const std::string &argv,
@@ -74,12 +116,34 @@ public:
                      std::chrono::milliseconds budget,
                      std::chrono::milliseconds budget_jitter,
                      std::optional<CpuFrequencyHz> req_freq,
-                     bool has_initialization);
+                     bool has_initialization,
+                     bool futex_yield);
 
-    /** Spawns system processes for all added Process instances. */
+    /**
+     * Spawns system processes for all added Process instances that were not spawned yet.
+     * The processes do not run until `attach_processes()` is called.
+     */
     void create_processes();
+    /** Moves the processes spawned by `create_processes()` to their cgroups. */
+    void attach_processes();
 
-    /** Kills all system processes from this partition. */
+    /**
+     * Starts replacing the process list, which is then defined by calling `add_process(...)`
+     * for each process. Used when the configuration is reloaded.
+     */
+    void begin_update();
+    /**
+     * Kills all running processes that were not reused by `add_process(...)`
+     * since `begin_update()`. Newly added processes are spawned by `create_processes()`.
+     */
+    void finish_update();
+    /** Destroys processes removed by `finish_update()` that already exited. */
+    void prune_retired_processes();
+
+    /**
+     * Kills all system processes from this partition, with a single write
+     * to `cgroup.kill` of the partition cgroup if the kernel supports it.
+     */
     void kill_all();
 
     /**
@@ -114,6 +178,27 @@ public:
      *  (basically, the next process for which it makes sense to run in current window)
      */
     Process *seek_pending_process();
+    /**
+     * Like `seek_pending_process()`, but also skips processes for which `skip(process)`
+     * returns true, e.g. processes already running on another CPU.
+     */
+    template<typename Pred>
+    Process *seek_pending_process(Pred skip)
+    {
+        if (stride_active) return seek_stride_process(skip);
+        for (size_t i = 0; i < processes.size(); i++) {
+            if (current_proc->is_pending() && !skip(*current_proc)) return &*current_proc;
+            move_to_next_proc();
+        }
+        // unlike above, the loop went around the whole queue, back to the starting position
+        return nullptr;
+    }
+
+    /**
+     * Enables stride scheduling of this partition when it runs as a BE partition;
+     * takes effect at the next `reset(...)`.
+     */
+    void set_stride_scheduling(bool enabled) { stride_scheduling = enabled; }
 
     /**
      * Registers a callback that is called whenever any process exits.
@@ -122,6 +207,12 @@ public:
      */
     void set_process_exit_cb(ExitCb new_exit_cb);
 
+    /**
+     * Returns true if processes are frozen using the cgroup v1 freezer hierarchy;
+     * otherwise, `cgroup.freeze` in the unified hierarchy is used.
+     */
+    [[nodiscard]] bool uses_v1_freezer() const { return !cgf.get_path().empty(); }
+
     /** Returns true if there are no running processes inside this partition. */
     [[nodiscard]] bool is_empty() const;
     [[nodiscard]] std::string get_name() const;
@@ -134,4 +225,51 @@ private:
     // cyclic queue
     void move_to_next_proc();
     void clear_completed_flag();
+
+    /** Heap order for `stride_heap`, ties are broken by the order of creation. */
+    static bool stride_order(const Process *a, const Process *b)
+    {
+        return a->get_pass() > b->get_pass() ||
+               (a->get_pass() == b->get_pass() && a->trace_id > b->trace_id);
+    }
+
+    /** Drops `stride_heap[i]` (outside the heap), which is not pending anymore. */
+    void drop_stride_process(size_t i)
+    {
+        stride_heap[i] = stride_heap.back();
+        stride_heap.pop_back();
+    }
+
+    /**
+     * Returns the pending process with the lowest pass for which `skip(process)` returns
+     * false. The returned process stays out of the heap until the next call, as its pass
+     * grows when it runs; processes skipped as running elsewhere stay out as well.
+     */
+    template<typename Pred>
+    Process *seek_stride_process(Pred skip)
+    {
+        auto heap_begin = stride_heap.begin();
+        // re-insert the processes returned by the previous calls with their new pass
+        for (size_t i = stride_heap_size; i < stride_heap.size();) {
+            if (!stride_heap[i]->is_pending()) {
+                // completed in this window, or exited; `reset(...)` adds it again
+                drop_stride_process(i);
+            } else if (skip(*stride_heap[i])) {
+                i++;
+            } else {
+                std::swap(stride_heap[i++], stride_heap[stride_heap_size++]);
+                std::push_heap(heap_begin, heap_begin + stride_heap_size, stride_order);
+            }
+        }
+        while (stride_heap_size > 0) {
+            std::pop_heap(heap_begin, heap_begin + stride_heap_size, stride_order);
+            Process *proc = stride_heap[--stride_heap_size];
+            if (!proc->is_pending()) {
+                drop_stride_process(stride_heap_size);
+            } else if (!skip(*proc)) {
+                return proc;
+            }
+        }
+        return nullptr;
+    }
 };
@@ -10,6 +10,8 @@ class PartitionManager
 {
 private:
     Partitions partitions;
+    /** Partitions removed by a configuration reload, kept until all their processes exit. */
+    Partitions retired_partitions{};
     std::function<void()> completion_cb = [] {};
     // initialized in `run_process_init`
     std::function<void()> init_cb = nullptr;
@@ -38,19 +40,20 @@ public:
 
         // used when partition is not contained in any slice, not really important
         const cpu_set default_cpu_set{};
-        const cpu_set *cpus_ptr;
         auto part_completion_cb = [this](Process &p) { process_init_completion_cb(p); };
 
-        // TODO: apparently, this is quite slow, investigate why
+        // we want to run init for each partition in the widest
+        //  cpu_set it will ever run in; otherwise, multi-threaded
+        //  program could initialize to run with lower number of threads,
+        //  which would be inefficient; this way, the process might run
+        //  on fewer cores than it has threads in some windows, but that
+        //  isn't as much of a problem for performance
+        // usually, the cpusets were already set in `create_processes`
+        auto widest_cpus = mf.find_widest_cpu_sets();
         for (auto &p : partitions) {
-            // we want to run init for each partition in the widest
-            //  cpu_set it will ever run in; otherwise, multi-threaded
-            //  program could initialize to run with lower number of threads,
-            //  which would be inefficient; this way, the process might run
-            //  on fewer cores than it has threads in some windows, but that
-            //  isn't as much of a problem for performance
-            cpus_ptr = mf.find_widest_cpu_set(p);
-            p.reset(true, cpus_ptr ? *cpus_ptr : default_cpu_set, part_completion_cb);
+            auto it = widest_cpus.find(&p);
+            const cpu_set &cpus = it != widest_cpus.end() ? *it->second : default_cpu_set;
+            p.reset(true, cpus, part_completion_cb);
         }
 
         // overwrite process exit callback set in constructor
@@ -83,13 +86,50 @@ public:
         }
     }
 
-    /** Spawns suspended processes from all partitions. */
-    void create_processes()
+    /**
+     * Kills all processes of partitions removed by a configuration reload (see
+     * `Config::update_scheduler_objects`), and registers the exit callback
+     * for newly added partitions.
+     */
+    void retire_partitions(Partitions &&removed)
+    {
+        for (auto &p : removed) {
+            p.kill_all();
+        }
+        retired_partitions.splice(retired_partitions.end(), removed);
+        set_exit_cb(&PartitionManager::process_exit_cb);
+    }
+
+    /** Destroys retired partitions and processes that already exited. */
+    void prune_retired()
+    {
+        retired_partitions.remove_if([](Partition &p) { return p.is_empty(); });
+        for (auto &p : partitions) {
+            p.prune_retired_processes();
+        }
+    }
+
+    /**
+     * Spawns suspended processes from all partitions.
+     *
+     * This is done in batches: first, the cpuset of each partition is set to the one used
+     * for initialization (see `run_process_init`), which is cheap while the cgroup is still
+     * empty; then, all processes are spawned; finally, all of them are moved to their
+     * cgroups back-to-back, which lets the kernel amortize the synchronization needed
+     * for each cgroup migration.
+     */
+    void create_processes(const MajorFrame &mf)
     {
         logger_process->info("Spawning scheduled processes");
+        auto widest_cpus = mf.find_widest_cpu_sets();
         for (auto &p : partitions) {
+            auto it = widest_cpus.find(&p);
+            if (it != widest_cpus.end()) p.set_cpus(*it->second);
             p.create_processes();
         }
+        for (auto &p : partitions) {
+            p.attach_processes();
+        }
         logger_process->info("Scheduled processes spawned");
     }
 
@@ -106,6 +146,30 @@ public:
         }
     }
 
+    [[nodiscard]] const Partitions &get_partitions() const { return partitions; }
+    /** Used to update the partitions when the configuration is reloaded. */
+    Partitions &get_partitions() { return partitions; }
+
+    /** Logs how long it took for the cgroup v2 freezer to freeze the processes. */
+    void log_freeze_stats() const
+    {
+        Process::FreezeStats total{};
+        for (auto &p : partitions) {
+            for (auto &proc : p.processes) {
+                auto &s = proc.get_freeze_stats();
+                total.count += s.count;
+                total.total += s.total;
+                total.max = std::max(total.max, s.max);
+            }
+        }
+        // nothing is measured with the v1 freezer
+        if (total.count == 0) return;
+        logger->debug("Freeze latency: avg '{:.1f} µs', max '{:.1f} µs' ({} freezes)",
+                      static_cast<double>(total.total.count()) / total.count / 1000.0,
+                      static_cast<double>(total.max.count()) / 1000.0,
+                      total.count);
+    }
+
     /**
      * Sets callback that is called when all partitions
      * are empty (so there are no processes to schedule).
@@ -124,6 +188,10 @@ private:
         for (auto &p : partitions) {
             p.set_process_exit_cb(proc_exit_cb);
         }
+        // processes of retired partitions may still be exiting
+        for (auto &p : retired_partitions) {
+            p.set_process_exit_cb(proc_exit_cb);
+        }
     }
 
     /** Called when a process exits in one of the managed partitions. */
@@ -152,6 +220,7 @@ private:
     void process_init_completion_cb(Process &proc)
     {
         proc.suspend();
+        proc.mark_initialized();
         remaining_process_inits--;
         if (remaining_process_inits == 0) {
             finish_process_init();
@@ -117,6 +117,8 @@ private: ///////////////////////////////////////////////////////////////////////
     std::list<CpufreqPolicy> policies{};
     /** Maps from policy name to matching `cpufreq` policy. */
     std::map<string, std::reference_wrapper<CpufreqPolicy>> policy_by_name{};
+    /** Must be destroyed before `policies`, see `start_async_writes`. */
+    std::optional<CpufreqWriter> writer{};
 
     using policy_iterator = std::list<CpufreqPolicy>::iterator;
 
@@ -153,6 +155,8 @@ public: ////////////////////////////////////////////////////////////////////////
 
     ~PowerManager()
     {
+        // finish the pending writes before anything is reset
+        writer.reset();
         // FIXME: we should first restore governors and THEN reset intel_pstate driver;
         //  also investigate if the way it currently is breaks anything
         if (!original_intel_pstate_status.empty()) {
@@ -162,6 +166,18 @@ public: ////////////////////////////////////////////////////////////////////////
         logger->debug("Resetting `cpufreq` governors to original values");
     }
 
+    /**
+     * Offloads the frequency writes of all policies to a `CpufreqWriter` thread running
+     * on `cpus`. Frequencies set after this call are written asynchronously.
+     */
+    void start_async_writes(const cpu_set &cpus)
+    {
+        writer.emplace(ev::get_default_loop(), policies, cpus);
+        for (auto &p : policies) {
+            p.set_writer(&*writer);
+        }
+    }
+
     /**
      * Lookup policy by name.
      * @param name - name of the directory in /sys/devices/system/cpu/cpufreq
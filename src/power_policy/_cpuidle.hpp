@@ -0,0 +1,108 @@
+#pragma once
+
+#include "_power_policy.hpp"
+#include "cpuidle_control.hpp"
+#include <memory>
+#include <unordered_map>
+
+/**
+ * Wraps another power policy and additionally limits the idle states of CPUs running
+ * SC partitions (see `CpuIdleControl`). During the BE partitions, and on CPUs without
+ * an SC partition, the original idle states are allowed.
+ *
+ * Enabled by the `DEMOS_CPUIDLE_LATENCY` environment variable, independently of the selected
+ * power policy, to which all events are forwarded.
+ *
+ * NOTE: file name is prefixed with '_', as this is not a standalone power policy
+ */
+class PowerPolicy_CpuIdle : public PowerPolicy
+{
+private:
+    std::unique_ptr<PowerPolicy> inner;
+    CpuIdleControl idle;
+    /** CPUs of the slices with an SC partition, for each window. */
+    std::unordered_map<const Window *, cpu_set> sc_cpus{};
+    const cpu_set no_cpus{};
+    /** CPUs currently limited; with slack reclaiming, the slices in BE phase are removed. */
+    cpu_set limited{};
+    /** Preallocated, as cpu_set operators allocate a new set. */
+    cpu_set tmp{};
+
+public:
+    PowerPolicy_CpuIdle(std::unique_ptr<PowerPolicy> inner, std::chrono::microseconds max_latency)
+        : inner(std::move(inner))
+        , idle(max_latency)
+    {}
+
+    void validate(const Windows &windows) override { inner->validate(windows); }
+    void validate_modes(const Modes &modes) override
+    {
+        inner->validate_modes(modes);
+        sc_cpus.clear();
+        for (const Mode &mode : modes) {
+            for (const Window &win : mode.windows) {
+                cpu_set &cpus = sc_cpus[&win];
+                for (const Slice &slice : win.slices) {
+                    if (slice.sc) cpus |= slice.cpus;
+                }
+            }
+        }
+    }
+    void check_modes(const Modes &modes) override { inner->check_modes(modes); }
+    void start_async_frequency_writes(const cpu_set &cpus) override
+    {
+        inner->start_async_frequency_writes(cpus);
+    }
+    bool supports_per_process_frequencies() override
+    {
+        return inner->supports_per_process_frequencies();
+    }
+    bool supports_per_slice_frequencies() override
+    {
+        return inner->supports_per_slice_frequencies();
+    }
+    void set_frequency_lead_time(std::optional<std::chrono::nanoseconds> lead) override
+    {
+        inner->set_frequency_lead_time(lead);
+    }
+    std::chrono::nanoseconds get_frequency_lead_time() override
+    {
+        return inner->get_frequency_lead_time();
+    }
+    bool supports_budget_scaling() override { return inner->supports_budget_scaling(); }
+    void set_reference_frequency(std::optional<CpuFrequencyHz> freq) override
+    {
+        PowerPolicy::set_reference_frequency(freq);
+        inner->set_reference_frequency(freq);
+    }
+    double get_budget_scale(const cpu_set &cpus) override { return inner->get_budget_scale(cpus); }
+
+    void on_window_prepare(Window &win) override { inner->on_window_prepare(win); }
+    void on_window_start(Window &win) override
+    {
+        limited = sc_cpus.at(&win);
+        idle.limit(limited);
+        inner->on_window_start(win);
+    }
+    void on_sc_start(Window &win) override { inner->on_sc_start(win); }
+    void on_be_start(Window &win) override
+    {
+        limited = no_cpus;
+        idle.limit(no_cpus);
+        inner->on_be_start(win);
+    }
+    void on_slice_be_start(Slice &slice) override
+    {
+        // limited &= ~slice.cpus
+        tmp = limited;
+        tmp &= slice.cpus;
+        limited ^= tmp;
+        idle.limit(limited);
+        inner->on_slice_be_start(slice);
+    }
+    void on_window_end(Window &win) override { inner->on_window_end(win); }
+
+    void on_process_start(Process &proc) override { inner->on_process_start(proc); }
+    void on_process_completed(Process &proc) override { inner->on_process_completed(proc); }
+    void on_process_end(Process &proc) override { inner->on_process_end(proc); }
+};
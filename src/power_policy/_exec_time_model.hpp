@@ -0,0 +1,160 @@
+#pragma once
+
+#include "cpufreq_policy.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Execution times of SC processes at each frequency of each CPU cluster, learned from
+ * measurements, from which the energy_aware power policy (see `PowerPolicy_EnergyAware`)
+ * selects the frequencies.
+ *
+ * `Proc` is the process type, which must provide `get_budget()`. It is a parameter, so that
+ * the model can be unit-tested without spawning processes.
+ *
+ * NOTE: file name is prefixed with '_', as this is not a power policy
+ */
+template<typename Proc>
+class ExecTimeModel
+{
+public:
+    using nanoseconds = std::chrono::nanoseconds;
+
+    /** @param margin - fraction of the budgets and of the window length kept in reserve */
+    explicit ExecTimeModel(double margin)
+        : margin{ margin }
+    {}
+
+    /** Adds a cluster with the given frequencies (ascending), returns its index. */
+    size_t add_cluster(std::vector<CpuFrequencyHz> freqs)
+    {
+        clusters.push_back(std::move(freqs));
+        return clusters.size() - 1;
+    }
+
+    [[nodiscard]] const std::vector<CpuFrequencyHz> &frequencies(size_t cluster) const
+    {
+        return clusters[cluster];
+    }
+
+    /**
+     * Predicted execution time of `proc` at the frequency `freq_i` of `cluster`.
+     *
+     * For frequencies that were not measured yet, the execution time is scaled from
+     * the closest measured frequency, preferring a higher one (which overestimates
+     * the execution time of memory-bound processes, rather than underestimating it).
+     * Returns nothing if no frequency of the cluster was measured.
+     */
+    [[nodiscard]] std::optional<nanoseconds> predict(const Proc &proc,
+                                                     size_t cluster,
+                                                     size_t freq_i) const
+    {
+        auto it = exec_times.find(&proc);
+        if (it == exec_times.end()) return std::nullopt;
+        const auto &times = it->second[cluster];
+        const auto &freqs = clusters[cluster];
+        if (times[freq_i] > nanoseconds::zero()) return times[freq_i];
+        auto from = [&](size_t j) {
+            return scaled(times[j], static_cast<double>(freqs[j]) / freqs[freq_i]);
+        };
+        for (size_t j = freq_i + 1; j < times.size(); j++) {
+            if (times[j] > nanoseconds::zero()) return from(j);
+        }
+        for (size_t j = freq_i; j-- > 0;) {
+            if (times[j] > nanoseconds::zero()) return from(j);
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Time after which `proc`, running at the frequency `freq_i` of `cluster`, exceeded its
+     * prediction plus the margin, or the budget shortened by the margin, whichever is earlier.
+     * Throws `std::bad_optional_access` if the process cannot be predicted.
+     */
+    [[nodiscard]] nanoseconds guard_limit(const Proc &proc, size_t cluster, size_t freq_i) const
+    {
+        return std::min(scaled(predict(proc, cluster, freq_i).value(), 1 + margin),
+                        scaled(proc.get_budget(), 1 - margin));
+    }
+
+    /**
+     * Index of the lowest frequency of `cluster` at which each of `procs` is predicted to finish
+     * within its budget, and all of them within `window_length`, both shortened by the margin.
+     * Returns the maximum frequency until all of `procs` were measured.
+     */
+    template<typename Procs>
+    [[nodiscard]] size_t lowest_feasible(const Procs &procs,
+                                         size_t cluster,
+                                         nanoseconds window_length) const
+    {
+        const size_t max_i = clusters[cluster].size() - 1;
+        for (size_t i = 0; i < max_i; i++) {
+            nanoseconds total{ 0 };
+            bool feasible = true;
+            for (const Proc &proc : procs) {
+                auto predicted = predict(proc, cluster, i);
+                if (!predicted || *predicted > scaled(proc.get_budget(), 1 - margin)) {
+                    feasible = false;
+                    break;
+                }
+                total += *predicted;
+            }
+            if (feasible && total <= scaled(window_length, 1 - margin)) return i;
+        }
+        return max_i;
+    }
+
+    /** Learns from an activation of `proc` that took `sample` at the frequency `freq_i`. */
+    void record_sample(const Proc &proc, size_t cluster, size_t freq_i, nanoseconds sample)
+    {
+        nanoseconds &estimate = exec_time(proc, cluster, freq_i);
+        // follow increases immediately and decreases slowly, as underestimating
+        //  the execution time may cause a missed deadline
+        estimate = std::max(sample, estimate - (estimate - sample) / 8);
+    }
+
+    /**
+     * Records that an activation of `proc` takes at least `elapsed` at the frequency `freq_i`,
+     * e.g. when it exceeded its prediction and the frequency was raised before it completed.
+     */
+    void record_lower_bound(const Proc &proc, size_t cluster, size_t freq_i, nanoseconds elapsed)
+    {
+        nanoseconds &estimate = exec_time(proc, cluster, freq_i);
+        estimate = std::max(estimate, elapsed);
+    }
+
+    /** Forgets the processes for which `pred` returns true. */
+    template<typename Pred>
+    void forget_if(Pred pred)
+    {
+        for (auto it = exec_times.begin(); it != exec_times.end();) {
+            it = pred(*it->first) ? exec_times.erase(it) : std::next(it);
+        }
+    }
+
+private:
+    const double margin;
+    /** Frequencies of each cluster, ascending. */
+    std::vector<std::vector<CpuFrequencyHz>> clusters{};
+    /** Estimated execution time for each cluster and frequency (zero = not measured). */
+    std::unordered_map<const Proc *, std::vector<std::vector<nanoseconds>>> exec_times{};
+
+    nanoseconds &exec_time(const Proc &proc, size_t cluster, size_t freq_i)
+    {
+        auto [it, inserted] = exec_times.try_emplace(&proc);
+        if (inserted) {
+            for (auto &freqs : clusters) it->second.emplace_back(freqs.size());
+        }
+        return it->second[cluster][freq_i];
+    }
+
+    static nanoseconds scaled(nanoseconds t, double factor)
+    {
+        return nanoseconds(static_cast<int64_t>(static_cast<double>(t.count()) * factor));
+    }
+};
@@ -0,0 +1,269 @@
+#pragma once
+
+#include "cpufreq_policy.hpp"
+#include "partition.hpp"
+#include "power_manager.hpp"
+#include "window.hpp"
+#include <chrono>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * CPU frequency of each cluster (`cpufreq` policy) for each window, planned ahead of time
+ * from the frequencies requested in the configuration.
+ *
+ * The plan is built once per configuration (see `PowerPolicy::validate_modes`), which also
+ * reports all conflicts at once, i.e. slices or processes that may run at the same time
+ * on the same cluster, but request different frequencies. At runtime, the power policy
+ * only looks up the planned frequencies, and it may issue them for the next window
+ * `get_lead_time()` before the window starts, so that the transition is already done
+ * when the window starts.
+ *
+ * NOTE: file name is prefixed with '_', as this is not a power policy
+ */
+class FrequencyPlan
+{
+public:
+    /** Where the requested frequencies come from. */
+    enum class Source
+    {
+        slices,
+        processes,
+    };
+
+    /** Planned frequency for each policy, in the order of `policies`; nullopt = not set. */
+    using Frequencies = std::vector<std::optional<CpuFrequencyHz>>;
+
+    const std::vector<CpufreqPolicy *> policies;
+
+    /**
+     * @param snap - if true, requested frequencies which cannot be set are replaced
+     *  by the closest one that can (see `CpufreqPolicy::snap_frequency`), instead of
+     *  being reported as errors
+     */
+    FrequencyPlan(std::vector<CpufreqPolicy *> policies, Source source, bool snap = false)
+        : policies(std::move(policies))
+        , source(source)
+        , snap(snap)
+    {}
+
+    /** Plans the frequencies of all `cpufreq` policies found by `pm`. */
+    FrequencyPlan(PowerManager &pm, Source source, bool snap = false)
+        : FrequencyPlan(all_policies(pm), source, snap)
+    {}
+
+    /**
+     * Validates the requested frequencies in all modes and replaces the plan.
+     * Throws a runtime_error listing all conflicts, if there are any.
+     */
+    void build(const Modes &modes)
+    {
+        plan.clear();
+        plan = make_plan(modes);
+    }
+
+    /** Like `build`, but keeps the current plan; used to check a reloaded configuration. */
+    void check(const Modes &modes) const { static_cast<void>(make_plan(modes)); }
+
+    /**
+     * Frequencies at the start of `win`; with `Source::processes`, these are the frequencies
+     * requested by the first processes of SC partitions.
+     */
+    [[nodiscard]] const Frequencies &at_window_start(const Window &win) const
+    {
+        return plan.at(&win);
+    }
+
+    /** Writes the frequencies planned for the start of `win`. */
+    void issue(const Window &win) const
+    {
+        const Frequencies &freqs = at_window_start(win);
+        for (size_t i = 0; i < policies.size(); i++) {
+            if (freqs[i]) policies[i]->write_frequency(*freqs[i]);
+        }
+    }
+
+    /** Sets the lead time; nullopt = use the measured transition latency. */
+    void set_lead_time(std::optional<std::chrono::nanoseconds> lead)
+    {
+        lead_time = lead;
+    }
+
+    /** How long before the start of a window its frequencies should be issued. */
+    [[nodiscard]] std::chrono::nanoseconds get_lead_time() const
+    {
+        if (lead_time) return *lead_time;
+        std::chrono::nanoseconds longest{ 0 };
+        for (const CpufreqPolicy *p : policies) {
+            longest = std::max(longest, p->get_transition_latency());
+        }
+        return longest;
+    }
+
+private:
+    const Source source;
+    const bool snap;
+    using Plan = std::unordered_map<const Window *, Frequencies>;
+    Plan plan{};
+    std::optional<std::chrono::nanoseconds> lead_time = std::chrono::nanoseconds(0);
+
+    /** Plans the frequencies of all windows in `modes`, throws if there are conflicts. */
+    [[nodiscard]] Plan make_plan(const Modes &modes) const
+    {
+        Plan new_plan;
+        std::vector<std::string> conflicts;
+        for (const Mode &mode : modes) {
+            // only show the mode name if there are multiple modes
+            std::string mode_desc = modes.size() > 1 ? " of mode '" + mode.name + "'" : "";
+            size_t window_i = 0;
+            for (const Window &win : mode.windows) {
+                Frequencies &freqs = new_plan[&win];
+                freqs.resize(policies.size());
+                for (size_t i = 0; i < policies.size(); i++) {
+                    std::string where = fmt::format("window #{}{}, CPU(s) {}",
+                                                    window_i,
+                                                    mode_desc,
+                                                    policies[i]->affected_cores.as_list());
+                    freqs[i] = plan_window(win, *policies[i], where, conflicts);
+                }
+                window_i++;
+            }
+        }
+        if (!conflicts.empty()) {
+            throw std::runtime_error(
+              fmt::format("Conflicting frequency requests:\n  {}", fmt::join(conflicts, "\n  ")));
+        }
+        return new_plan;
+    }
+
+    /** Frequencies requested by each slice on the CPU cluster, with a requester description. */
+    using Requests = std::vector<std::vector<std::pair<CpuFrequencyHz, std::string>>>;
+
+    std::optional<CpuFrequencyHz> plan_window(const Window &win,
+                                              const CpufreqPolicy &cp,
+                                              const std::string &where,
+                                              std::vector<std::string> &conflicts) const
+    {
+        // `sc_be` = requests that may run at the same time with slack reclaiming
+        Requests window_start, sc, be, sc_be;
+        for (const Slice &slice : win.slices) {
+            if (!(slice.cpus & cp.affected_cores)) continue;
+            if (source == Source::slices) {
+                auto &r = window_start.emplace_back();
+                if (slice.requested_frequency) {
+                    std::string desc = "slice on CPU(s) " + slice.cpus.as_list();
+                    r.emplace_back(settable(cp, *slice.requested_frequency, desc), desc);
+                }
+                continue;
+            }
+            // processes of a partition run sequentially, SC partitions of all slices run
+            //  at the same time, and BE partitions run after all SC partitions finish
+            //  (see `Window::slice_sc_end_cb`)
+            add_process_requests(slice.sc, cp, sc.emplace_back());
+            sc_be.push_back(sc.back());
+            if (slice.parallel_be) {
+                // the processes of a parallel BE partition run at the same time
+                std::vector<std::pair<CpuFrequencyHz, std::string>> requests;
+                add_process_requests(slice.be, cp, requests);
+                for (auto &r : requests) {
+                    be.push_back({ r });
+                    sc_be.push_back({ r });
+                }
+            } else {
+                add_process_requests(slice.be, cp, be.emplace_back());
+                auto &r = sc_be.back();
+                r.insert(r.end(), be.back().begin(), be.back().end());
+            }
+            auto &r = window_start.emplace_back();
+            if (slice.sc && !slice.sc->processes.empty()) {
+                const Process &first = slice.sc->processes.front();
+                if (first.requested_frequency) {
+                    r.emplace_back(cp.snap_frequency(*first.requested_frequency), "");
+                }
+            }
+        }
+        if (source == Source::slices) {
+            check_conflicts(window_start, where, conflicts);
+        } else if (win.reclaim_slack) {
+            // BE partitions may run while SC partitions of other slices still run
+            check_conflicts(sc_be, where + " (SC and BE partitions)", conflicts);
+        } else {
+            // the first SC processes are checked as a part of SC partitions
+            check_conflicts(sc, where + " (SC partitions)", conflicts);
+            check_conflicts(be, where + " (BE partitions)", conflicts);
+        }
+        for (auto &r : window_start) {
+            if (!r.empty()) return r.front().first;
+        }
+        return std::nullopt;
+    }
+
+    void add_process_requests(const Partition *part,
+                              const CpufreqPolicy &cp,
+                              std::vector<std::pair<CpuFrequencyHz, std::string>> &r) const
+    {
+        if (!part) return;
+        for (const Process &proc : part->processes) {
+            if (!proc.requested_frequency) continue;
+            std::string desc = "process '" + proc.argv + "'";
+            r.emplace_back(settable(cp, *proc.requested_frequency, desc), desc);
+        }
+    }
+
+    /** Validates or snaps the frequency requested by `desc`. */
+    [[nodiscard]] CpuFrequencyHz settable(const CpufreqPolicy &cp,
+                                          CpuFrequencyHz freq,
+                                          const std::string &desc) const
+    {
+        if (!snap) {
+            cp.validate_frequency(freq);
+            return freq;
+        }
+        CpuFrequencyHz snapped = cp.snap_frequency(freq);
+        if (snapped != freq) {
+            logger->warn("Frequency '{}' requested by {} cannot be set on CPU(s) {}, using '{}'",
+                         freq,
+                         desc,
+                         cp.affected_cores.as_list(),
+                         snapped);
+        }
+        return snapped;
+    }
+
+    static std::vector<CpufreqPolicy *> all_policies(PowerManager &pm)
+    {
+        std::vector<CpufreqPolicy *> policies;
+        for (auto &p : pm.policy_iter()) policies.push_back(&p);
+        return policies;
+    }
+
+    /**
+     * Requests from different slices conflict if they differ; requests from a single
+     * slice never run at the same time.
+     */
+    static void check_conflicts(const Requests &requests,
+                                const std::string &where,
+                                std::vector<std::string> &conflicts)
+    {
+        std::set<uint64_t> distinct;
+        size_t requesting_slices = 0;
+        for (auto &r : requests) {
+            if (r.empty()) continue;
+            requesting_slices++;
+            for (auto &[freq, _] : r) distinct.insert(freq);
+        }
+        // if a slice requests 2 different frequencies, at least one of them differs
+        //  from any frequency requested by another slice
+        if (requesting_slices < 2 || distinct.size() < 2) return;
+        std::vector<std::string> descs;
+        for (auto &r : requests) {
+            for (auto &[freq, desc] : r) {
+                descs.push_back(fmt::format("'{}' ({})", freq, desc));
+            }
+        }
+        conflicts.push_back(where + ": " + fmt::format("{}", fmt::join(descs, ", ")));
+    }
+};
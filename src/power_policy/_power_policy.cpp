@@ -6,6 +6,7 @@
 
 // TODO: MK: possibly create a meson build step that lists power policies
 //  inside this directory, and generates both includes and PP(...) calls
+#include "power_policy/energy_aware.hpp"
 #include "power_policy/high.hpp"
 #include "power_policy/imx8_alternating.hpp"
 #include "power_policy/imx8_fixed.hpp"
@@ -15,6 +16,7 @@
 #include "power_policy/minbe.hpp"
 #include "power_policy/none.hpp"
 #include "power_policy/per_process.hpp"
+#include "power_policy/per_slice.hpp"
 
 
 // after multiple template-based attempts, a macro solution was chosen,
@@ -44,12 +46,14 @@ static const std::map<std::string,
       //  arguments and creates a unique_ptr<PowerPolicy_...>, passing the arguments
       //  provided by the user
       PP("minbe", PowerPolicy_MinBE, 0),
+      PP("energy_aware", PowerPolicy_EnergyAware, 1),
       PP("low", PowerPolicy_FixedLow, 0),
       PP("high", PowerPolicy_FixedHigh, 0),
       PP("per_process", PowerPolicy_PerProcess, 0),
+      PP("per_slice", PowerPolicy_PerSlice, 0),
       PP("imx8_alternating", PowerPolicy_Imx8_Alternating, 4),
       PP("imx8_fixed", PowerPolicy_Imx8_Fixed, 2),
-      PP("imx8_per_process", PowerPolicy_Imx8_PerProcess, 0), // TODO make alias of PowerPolicy_PerProcess if it works correctly
+      PP("imx8_per_process", PowerPolicy_Imx8_PerProcess, 0),
       PP("imx8_per_slice", PowerPolicy_Imx8_PerSlice, 0),
   };
 
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <chrono>
 #include <memory>
+#include <optional>
 #include <power_manager.hpp>
 #include <process.hpp>
 #include <window.hpp>
@@ -22,16 +24,75 @@ public:
     virtual ~PowerPolicy() = default;
 
     virtual void validate(const Windows &) {}
+    /**
+     * Called with the windows of all modes each time the configuration is loaded.
+     * By default, validates the windows of each mode separately.
+     */
+    virtual void validate_modes(const Modes &modes)
+    {
+        for (const Mode &mode : modes) validate(mode.windows);
+    }
+    /**
+     * Throws if the policy cannot run `modes`, like `validate_modes`, but keeps the state
+     * of the policy; used to check a reloaded configuration before it replaces the current one.
+     */
+    virtual void check_modes(const Modes &modes)
+    {
+        for (const Mode &mode : modes) validate(mode.windows);
+    }
+    /**
+     * Writes CPU frequencies from a separate thread running on `cpus` from now on,
+     * see `CpufreqWriter`. Does nothing for policies without power management.
+     */
+    virtual void start_async_frequency_writes(const cpu_set &) {}
     virtual bool supports_per_process_frequencies() { return false; }
     virtual bool supports_per_slice_frequencies() { return false; }
+    /**
+     * Sets how long before the start of each window `on_window_prepare` is called;
+     * nullopt = the measured frequency transition latency. Does nothing for policies
+     * which do not plan the frequencies ahead of time.
+     */
+    virtual void set_frequency_lead_time(std::optional<std::chrono::nanoseconds>) {}
+    /** Zero if `on_window_prepare` should not be called. */
+    virtual std::chrono::nanoseconds get_frequency_lead_time() { return {}; }
+
+    virtual bool supports_budget_scaling() { return false; }
+    /**
+     * Makes process budgets relative to `freq`, see `get_budget_scale`;
+     * nullopt = budgets are not scaled.
+     */
+    virtual void set_reference_frequency(std::optional<CpuFrequencyHz> freq)
+    {
+        reference_frequency = freq;
+    }
+    /** True if the CPU frequency must be set before the process budgets are computed. */
+    [[nodiscard]] bool scales_budgets() const { return reference_frequency.has_value(); }
+    /**
+     * Factor by which the budgets of processes running on `cpus` are multiplied, i.e.
+     * the ratio of the reference frequency to the current frequency of `cpus` (the lowest
+     * one, if the CPUs belong to multiple clusters).
+     */
+    virtual double get_budget_scale(const cpu_set &) { return 1; }
+
+    /** Called `get_frequency_lead_time()` before the start of the next window. */
+    virtual void on_window_prepare(Window &) {}
 
     virtual void on_window_start(Window &) {}
     virtual void on_sc_start(Window &) {}
+    /** Called when the BE partitions of all slices in the window are running. */
     virtual void on_be_start(Window &) {}
+    /**
+     * With `Window::reclaim_slack`, called when the BE partition of a single slice starts,
+     * while SC partitions of other slices may still run; `on_be_start` follows after
+     * the SC partitions of all slices finish.
+     */
+    virtual void on_slice_be_start(Slice &) {}
     virtual void on_window_end(Window &) {}
 
     // TODO: check the performance impact, potentially hide it behind a compile-time flag
     virtual void on_process_start(Process &) {}
+    /** Called when the running process signals completion, before `on_process_end`. */
+    virtual void on_process_completed(Process &) {}
     virtual void on_process_end(Process &) {}
 
     // it seems a bit weird to have what's essentially an input parsing function here,
@@ -43,6 +104,9 @@ public:
      * `<policy_name>:<arg1>,<arg2>,...`
      */
     static std::unique_ptr<PowerPolicy> setup_power_policy(const std::string &policy_str);
+
+protected:
+    std::optional<CpuFrequencyHz> reference_frequency{};
 };
 
 /**
@@ -51,6 +115,27 @@ public:
  * the more general PowerPolicy interface instead of this one.
  */
 class PmPowerPolicy : public PowerPolicy {
+public:
+    void start_async_frequency_writes(const cpu_set &cpus) override
+    {
+        pm.start_async_writes(cpus);
+    }
+
+    bool supports_budget_scaling() override { return true; }
+    double get_budget_scale(const cpu_set &cpus) override
+    {
+        if (!reference_frequency) return 1;
+        // the slowest cluster determines how long the work takes
+        std::optional<CpuFrequencyHz> slowest{};
+        for (auto &p : pm.policy_iter()) {
+            auto freq = p.get_current_frequency();
+            if (!freq || (slowest && *freq >= *slowest) || !(cpus & p.affected_cores)) continue;
+            slowest = freq;
+        }
+        // while the frequency is unknown, the budgets are not scaled
+        return slowest ? static_cast<double>(*reference_frequency) / *slowest : 1;
+    }
+
 protected:
     PowerManager pm{};
 };
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "_exec_time_model.hpp"
+#include "_power_policy.hpp"
+#include "power_manager.hpp"
+#include "timerfd.hpp"
+#include "window.hpp"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Runs SC partitions at the lowest frequency at which they are predicted to finish in time,
+ * and BE partitions at the minimum frequency.
+ *
+ * The policy learns the execution time of each SC process at each frequency of its CPU
+ * cluster from the process completions (so only processes which signal completion through
+ * the DEmOS process library are considered). Only activations that completed in a single
+ * run at a single frequency are learned from. At the start of each window, it selects for
+ * each cluster the lowest frequency at which each SC process is predicted to finish within
+ * its budget, and the SC partition of each slice within the window, both shortened by
+ * the margin (see `ExecTimeModel`). Until all SC processes of a slice were measured, its
+ * cluster runs at the maximum frequency.
+ *
+ * If an SC process runs longer than predicted (plus the margin), the frequency
+ * of its cluster is raised to the maximum for the rest of the window, and the time
+ * the process ran so far becomes the lower bound of its execution time at the previous
+ * frequency.
+ *
+ * A slice with CPUs from multiple clusters is predicted on the cluster with most of its
+ * CPUs; the other clusters run at the maximum frequency while it runs.
+ *
+ * Argument: the margin, in percent of the budget and of the window length.
+ */
+class PowerPolicy_EnergyAware : public PmPowerPolicy
+{
+private:
+    using time_point = std::chrono::steady_clock::time_point;
+    using nanoseconds = std::chrono::nanoseconds;
+
+    struct Cluster
+    {
+        CpufreqPolicy &policy;
+        /** Frequencies to select from, ascending (see `ExecTimeModel::frequencies`). */
+        const std::vector<CpuFrequencyHz> &freqs;
+        /** Index of the current frequency in `freqs`. */
+        size_t current = 0;
+        /** Incremented on each frequency change, to discard measurements spanning it. */
+        uint64_t generation = 0;
+        /** Raises the frequency when a running SC process exceeds its predicted time. */
+        std::unique_ptr<ev::timerfd> guard;
+        std::vector<std::pair<const Process *, time_point>> guarded{};
+    };
+
+    /** Current SC run of a process. */
+    struct ProcessRun
+    {
+        size_t cluster;
+        time_point start;
+        uint64_t generation;
+    };
+
+    /** SC partition of a slice, with the clusters of its CPUs. */
+    struct ScSlice
+    {
+        const Partition *sc;
+        /** Cluster with most CPUs of the slice, used for the prediction. */
+        size_t cluster;
+        /** Other clusters with CPUs of the slice. */
+        std::vector<size_t> other_clusters;
+    };
+
+    ExecTimeModel<Process> model;
+    /** Clusters, in the order of `model` clusters; not resized after the constructor. */
+    std::vector<Cluster> clusters{};
+    std::unordered_map<const Process *, ProcessRun> runs{};
+    std::unordered_map<const Window *, std::vector<ScSlice>> sc_slices{};
+    /** SC slices of the current window while the SC partitions run, otherwise nullptr. */
+    const std::vector<ScSlice> *running_sc = nullptr;
+    uint64_t raised_count = 0;
+    /** Frequency index selected for each cluster, reused to avoid allocations. */
+    std::vector<size_t> selected{};
+
+public:
+    explicit PowerPolicy_EnergyAware(const std::string &margin_percent)
+    try
+      : PmPowerPolicy{}
+      , model{ parse_margin(margin_percent) }
+    {
+        std::vector<CpufreqPolicy *> active;
+        for (auto &p : pm.policy_iter()) {
+            if (p.active) active.push_back(&p);
+        }
+        // add all clusters to the model first, so that the references to their frequencies
+        //  are not invalidated
+        for (CpufreqPolicy *p : active) model.add_cluster(frequency_steps(*p));
+        for (size_t i = 0; i < active.size(); i++) {
+            clusters.push_back({ *active[i], model.frequencies(i), 0, 0, nullptr });
+        }
+        for (size_t i = 0; i < clusters.size(); i++) {
+            Cluster &c = clusters[i];
+            c.guard = std::make_unique<ev::timerfd>(ev::get_default_loop());
+            c.guard->set([this, i] { raise(clusters[i]); });
+            // learn at the maximum frequency first; also used for initialization
+            c.current = c.freqs.size() - 1;
+            c.policy.write_frequency(c.freqs[c.current]);
+        }
+        selected.resize(clusters.size());
+    } catch (const std::logic_error &) { // std::invalid_argument or std::out_of_range
+        throw_with_nested(
+          runtime_error("The energy_aware power policy argument must be a margin in percent"));
+    }
+
+    PowerPolicy_EnergyAware(const PowerPolicy_EnergyAware &) = delete;
+    PowerPolicy_EnergyAware &operator=(const PowerPolicy_EnergyAware &) = delete;
+
+    ~PowerPolicy_EnergyAware() override
+    {
+        logger->debug("Energy-aware policy raised the frequency after a misprediction '{}' times",
+                      raised_count);
+    }
+
+    void validate_modes(const Modes &modes) override
+    {
+        sc_slices.clear();
+        running_sc = nullptr;
+        std::unordered_set<const Process *> present;
+        for (const Mode &mode : modes) {
+            for (const Window &win : mode.windows) {
+                auto &slices = sc_slices[&win];
+                for (const Slice &slice : win.slices) {
+                    if (!slice.sc) continue;
+                    slices.push_back(assign_clusters(slice));
+                    for (const Process &proc : slice.sc->processes) present.insert(&proc);
+                }
+            }
+        }
+        // forget processes removed by a configuration reload
+        model.forget_if([&](const Process &proc) { return !present.count(&proc); });
+        for (auto it = runs.begin(); it != runs.end();) {
+            it = present.count(it->first) ? std::next(it) : runs.erase(it);
+        }
+    }
+
+    void check_modes(const Modes &modes) override
+    {
+        for (const Mode &mode : modes) {
+            for (const Window &win : mode.windows) {
+                for (const Slice &slice : win.slices) {
+                    if (slice.sc) static_cast<void>(assign_clusters(slice));
+                }
+            }
+        }
+    }
+
+    void on_window_start(Window &win) override
+    {
+        running_sc = &sc_slices.at(&win);
+        std::fill(selected.begin(), selected.end(), 0);
+        for (const ScSlice &s : *running_sc) {
+            selected[s.cluster] = std::max(
+              selected[s.cluster], model.lowest_feasible(s.sc->processes, s.cluster, win.length));
+        }
+        for (const ScSlice &s : *running_sc) {
+            for (size_t o : s.other_clusters) selected[o] = clusters[o].freqs.size() - 1;
+        }
+        for (size_t i = 0; i < clusters.size(); i++) set_frequency(clusters[i], selected[i]);
+    }
+
+    void on_be_start(Window &) override
+    {
+        running_sc = nullptr;
+        for (Cluster &c : clusters) set_frequency(c, 0);
+    }
+
+    void on_window_end(Window &) override { running_sc = nullptr; }
+
+    void on_process_start(Process &proc) override
+    {
+        if (!running_sc) return;
+        auto s = std::find_if(running_sc->begin(), running_sc->end(), [&](const ScSlice &s) {
+            return s.sc == &proc.part;
+        });
+        if (s == running_sc->end()) return;
+        Cluster &c = clusters[s->cluster];
+        auto now = std::chrono::steady_clock::now();
+        runs.insert_or_assign(&proc, ProcessRun{ s->cluster, now, c.generation });
+        if (c.current + 1 == c.freqs.size()) return; // cannot raise anyway
+        // the frequency was only lowered if the process was predicted
+        c.guarded.emplace_back(&proc, now + model.guard_limit(proc, s->cluster, c.current));
+        arm_guard(c);
+    }
+
+    void on_process_completed(Process &proc) override
+    {
+        auto it = runs.find(&proc);
+        if (it == runs.end()) return;
+        const ProcessRun &run = it->second;
+        Cluster &c = clusters[run.cluster];
+        // discard the measurement if the frequency changed while the process was running
+        //  (see `raise`), or if the activation started in an earlier run (i.e., it overran
+        //  its budget or the window), which may have been at another frequency
+        if (c.generation != run.generation || proc.get_activation_runs() != 0) return;
+        model.record_sample(
+          proc, run.cluster, c.current, std::chrono::steady_clock::now() - run.start);
+    }
+
+    void on_process_end(Process &proc) override
+    {
+        auto it = runs.find(&proc);
+        if (it == runs.end()) return;
+        Cluster &c = clusters[it->second.cluster];
+        runs.erase(it);
+        auto g = std::find_if(
+          c.guarded.begin(), c.guarded.end(), [&](auto &g) { return g.first == &proc; });
+        if (g == c.guarded.end()) return;
+        c.guarded.erase(g);
+        arm_guard(c);
+    }
+
+private:
+    static double parse_margin(const std::string &percent)
+    {
+        const double margin = std::stoul(percent) / 100.0;
+        if (margin >= 1) throw runtime_error("margin must be under 100 %");
+        return margin;
+    }
+
+    /** Available frequencies, or evenly spaced steps if the driver does not list them. */
+    static std::vector<CpuFrequencyHz> frequency_steps(const CpufreqPolicy &p)
+    {
+        std::vector<CpuFrequencyHz> freqs;
+        if (p.available_frequencies) {
+            freqs = *p.available_frequencies;
+        } else {
+            // any frequency between min and max can be set (see `CpufreqPolicy::snap_frequency`)
+            const uint64_t steps = 8;
+            for (uint64_t i = 0; i < steps; i++) {
+                freqs.emplace_back(p.min_frequency +
+                                   (p.max_frequency - p.min_frequency) * i / (steps - 1));
+            }
+        }
+        std::sort(freqs.begin(), freqs.end(), [](auto a, auto b) { return a.freq < b.freq; });
+        return freqs;
+    }
+
+    ScSlice assign_clusters(const Slice &slice) const
+    {
+        ScSlice s{ slice.sc, 0, {} };
+        unsigned most = 0;
+        for (size_t i = 0; i < clusters.size(); i++) {
+            unsigned count = (slice.cpus & clusters[i].policy.affected_cores).count();
+            if (count == 0) continue;
+            s.other_clusters.push_back(i);
+            if (count > most) {
+                most = count;
+                s.cluster = i;
+            }
+        }
+        if (most == 0) {
+            throw runtime_error("No cpufreq policy controls the CPU(s) " + slice.cpus.as_list());
+        }
+        s.other_clusters.erase(
+          std::find(s.other_clusters.begin(), s.other_clusters.end(), s.cluster));
+        return s;
+    }
+
+    void set_frequency(Cluster &c, size_t freq_i)
+    {
+        if (freq_i == c.current) return;
+        c.current = freq_i;
+        c.generation++;
+        c.policy.write_frequency(c.freqs[freq_i]);
+    }
+
+    void arm_guard(Cluster &c)
+    {
+        if (c.guarded.empty()) {
+            c.guard->stop();
+            return;
+        }
+        auto earliest = std::min_element(
+          c.guarded.begin(), c.guarded.end(), [](auto &a, auto &b) { return a.second < b.second; });
+        c.guard->start(earliest->second);
+    }
+
+    void raise(Cluster &c)
+    {
+        TRACE("SC process exceeded its predicted execution time, raising the frequency of '{}'",
+              c.policy.name);
+        raised_count++;
+        // the completion of the guarded processes is not learned from after the change,
+        //  so at least record that the previous frequency is too low for them
+        auto now = std::chrono::steady_clock::now();
+        for (auto &g : c.guarded) {
+            const ProcessRun &run = runs.at(g.first);
+            // the process may have started before a previous change of the frequency
+            if (run.generation != c.generation) continue;
+            model.record_lower_bound(*g.first, run.cluster, c.current, now - run.start);
+        }
+        c.guarded.clear();
+        set_frequency(c, c.freqs.size() - 1);
+    }
+};
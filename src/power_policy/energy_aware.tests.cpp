@@ -0,0 +1,101 @@
+#include "tests/acutest.h"
+
+#include "power_policy/_exec_time_model.hpp"
+#include <array>
+
+using namespace std::chrono_literals;
+using std::chrono::nanoseconds;
+
+struct FakeProcess
+{
+    std::chrono::milliseconds budget;
+    [[nodiscard]] std::chrono::milliseconds get_budget() const { return budget; }
+};
+
+/** Model of a single cluster with frequencies of 600, 896 and 1200 MHz. */
+static ExecTimeModel<FakeProcess> make_model(double margin)
+{
+    ExecTimeModel<FakeProcess> model(margin);
+    model.add_cluster({ CpuFrequencyHz{ 600'000'000 },
+                        CpuFrequencyHz{ 896'000'000 },
+                        CpuFrequencyHz{ 1200'000'000 } });
+    return model;
+}
+
+static void test_predict()
+{
+    auto model = make_model(0.1);
+    FakeProcess p{ 30ms };
+    TEST_CHECK(!model.predict(p, 0, 2));
+
+    model.record_sample(p, 0, 2, 10ms);
+    TEST_CHECK(model.predict(p, 0, 2) == nanoseconds(10ms));
+    // scaled from the measured frequency
+    TEST_CHECK(model.predict(p, 0, 1) == nanoseconds(13'392'857));
+    TEST_CHECK(model.predict(p, 0, 0) == nanoseconds(20ms));
+
+    // a higher measured frequency is preferred over a lower one
+    model.record_sample(p, 0, 0, 15ms);
+    TEST_CHECK(model.predict(p, 0, 0) == nanoseconds(15ms));
+    TEST_CHECK(model.predict(p, 0, 1) == nanoseconds(13'392'857));
+
+    // increases are followed immediately, decreases slowly
+    model.record_sample(p, 0, 2, 20ms);
+    TEST_CHECK(model.predict(p, 0, 2) == nanoseconds(20ms));
+    model.record_sample(p, 0, 2, 12ms);
+    TEST_CHECK(model.predict(p, 0, 2) == nanoseconds(19ms));
+
+    model.forget_if([&](const FakeProcess &proc) { return &proc == &p; });
+    TEST_CHECK(!model.predict(p, 0, 2));
+}
+
+static void test_lowest_feasible()
+{
+    auto model = make_model(0.1);
+    std::array<FakeProcess, 2> procs{ FakeProcess{ 30ms }, FakeProcess{ 30ms } };
+
+    // the maximum frequency until all processes were measured
+    model.record_sample(procs[0], 0, 2, 10ms);
+    TEST_CHECK(model.lowest_feasible(procs, 0, 100ms) == 2);
+
+    model.record_sample(procs[1], 0, 2, 10ms);
+    TEST_CHECK(model.lowest_feasible(procs, 0, 100ms) == 0);
+    // 2 * 20 ms at 600 MHz do not fit into 90 % of the window, 2 * 13.4 ms at 896 MHz do
+    TEST_CHECK(model.lowest_feasible(procs, 0, 40ms) == 1);
+    // nothing fits, the maximum frequency is used anyway
+    TEST_CHECK(model.lowest_feasible(procs, 0, 20ms) == 2);
+
+    // 20 ms at 600 MHz does not fit into 90 % of the budget, 13.4 ms at 896 MHz does
+    std::array<FakeProcess, 1> short_budget{ FakeProcess{ 15ms } };
+    model.record_sample(short_budget[0], 0, 2, 10ms);
+    TEST_CHECK(model.lowest_feasible(short_budget, 0, 100ms) == 1);
+}
+
+static void test_raise_on_mispredict()
+{
+    auto model = make_model(0.1);
+    std::array<FakeProcess, 1> procs{ FakeProcess{ 24ms } };
+    FakeProcess &p = procs[0];
+    model.record_sample(p, 0, 2, 10ms);
+    TEST_CHECK(model.lowest_feasible(procs, 0, 100ms) == 0);
+
+    // raised when the prediction plus the margin, or 90 % of the budget, is exceeded
+    TEST_CHECK(model.guard_limit(p, 0, 0) == nanoseconds(21'600'000));
+    TEST_CHECK(model.guard_limit(p, 0, 2) == nanoseconds(11ms));
+
+    // the process ran 23 ms before the frequency was raised, so it does not fit at 600 MHz
+    model.record_lower_bound(p, 0, 0, 23ms);
+    TEST_CHECK(model.predict(p, 0, 0) == nanoseconds(23ms));
+    TEST_CHECK(model.lowest_feasible(procs, 0, 100ms) == 1);
+
+    // a lower bound does not decrease the estimate
+    model.record_lower_bound(p, 0, 0, 5ms);
+    TEST_CHECK(model.predict(p, 0, 0) == nanoseconds(23ms));
+}
+
+TEST_LIST = {
+    { "predict", test_predict },
+    { "lowest_feasible", test_lowest_feasible },
+    { "raise_on_mispredict", test_raise_on_mispredict },
+    { nullptr, nullptr },
+};
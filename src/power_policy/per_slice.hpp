@@ -0,0 +1,50 @@
+#pragma once
+
+#include "_frequency_plan.hpp"
+#include "_power_policy.hpp"
+#include "power_manager.hpp"
+#include "slice.hpp"
+#include <optional>
+
+/**
+ * Set frequency based on the currently executing slice.
+ *
+ * Works with any CPU cluster layout; the clusters are the `cpufreq` policies found
+ * by `PowerManager`, and a slice sets the frequency of all clusters its CPUs belong to.
+ * The frequency of each cluster in each window is planned when the configuration
+ * is loaded, and all collisions (multiple slices request different frequencies for
+ * the same CPU cluster) are reported at once (see `FrequencyPlan`).
+ *
+ * Requested frequencies which cannot be set are snapped to the closest one which can
+ * (see `CpufreqPolicy::snap_frequency`), so that the same configuration can be used
+ * on CPUs with different frequencies, or without a list of available frequencies
+ * (`intel_pstate` in passive mode).
+ */
+class PowerPolicy_PerSlice : public PmPowerPolicy
+{
+protected:
+    FrequencyPlan plan;
+
+    explicit PowerPolicy_PerSlice(bool snap)
+        : plan(pm, FrequencyPlan::Source::slices, snap)
+    {}
+
+public:
+    PowerPolicy_PerSlice()
+        : PowerPolicy_PerSlice(true)
+    {}
+
+    // Validate that the requested frequencies do not collide
+    void validate_modes(const Modes &modes) override { plan.build(modes); }
+    void check_modes(const Modes &modes) override { plan.check(modes); }
+    bool supports_per_slice_frequencies() override { return true; }
+
+    void set_frequency_lead_time(std::optional<std::chrono::nanoseconds> lead) override
+    {
+        plan.set_lead_time(lead);
+    }
+    std::chrono::nanoseconds get_frequency_lead_time() override { return plan.get_lead_time(); }
+
+    void on_window_prepare(Window &win) override { plan.issue(win); }
+    void on_window_start(Window &win) override { plan.issue(win); }
+};
@@ -2,10 +2,16 @@
 #include "lib/check_lib.hpp"
 #include "log.hpp"
 #include "partition.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <lib/assert.hpp>
+#include <linux/sched.h>
+#include <sched.h>
+#include <sys/syscall.h>
 #include <sys/eventfd.h>
 
 using namespace std::placeholders;
@@ -31,51 +37,127 @@ Process::Process(ev::loop_ref loop,
                  milliseconds budget,
                  milliseconds budget_jitter,
                  std::optional<CpuFrequencyHz> req_freq,
-                 bool has_initialization)
+                 bool has_initialization,
+                 bool futex_yield)
     : part(partition)
     , requested_frequency(req_freq)
     , argv(std::move(argv))
+    , trace_id(schedule_trace.register_subject(this->argv))
     // budget +- (jitter / 2)
     , jitter_distribution_ms(-budget_jitter.count() / 2,
                              budget_jitter.count() - budget_jitter.count() / 2)
     , loop(loop)
     , efd_continue(CHECK(eventfd(0, EFD_SEMAPHORE)))
+    , futex_yield(futex_yield)
     , cge(loop,
           partition.cge,
           name,
-          std::bind(&Process::populated_cb, this, _1)) // NOLINT(modernize-avoid-bind)
-    , cgf(partition.cgf, name)
+          std::bind(&Process::populated_cb, this, _1), // NOLINT(modernize-avoid-bind)
+          partition.uses_v1_freezer()
+            ? nullptr
+            : CgroupEvents::FrozenCb(
+                std::bind(&Process::frozen_cb, this, _1))) // NOLINT(modernize-avoid-bind)
     , working_dir(std::move(working_dir))
     , budget(budget)
     , actual_budget(budget)
+    , configured_budget(budget)
     , has_initialization(has_initialization)
 {
     // check that randomized budget cannot be negative
     // actual budget is `budget +- (jitter / 2)`
     ASSERT(2 * budget >= budget_jitter);
+    if (partition.uses_v1_freezer()) {
+        cgf.emplace(partition.cgf, name);
+    }
     suspend();
     completed_w.set(std::bind(&Process::completed_cb, this)); // NOLINT(modernize-avoid-bind)
     completed_w.start();
     child_w.set<Process, &Process::child_terminated_cb>(this);
 }
 
-void Process::exec()
+/** See `Process::set_spawn_affinity`; unset while DEmOS runs with its original affinity. */
+static std::optional<cpu_set> spawn_affinity{};
+
+void Process::set_spawn_affinity(const cpu_set &cpus)
+{
+    spawn_affinity = cpus;
+}
+
+/** Set when the kernel does not support `CLONE_INTO_CGROUP`, to avoid retrying for each process. */
+static bool clone_into_cgroup_unsupported = false;
+
+/**
+ * Like `fork()`, but the child is created directly in the cgroup referred to by `cgroup_fd`.
+ * Returns -1 if this is not supported by the kernel (Linux < 5.7).
+ *
+ * The raw syscall bypasses the glibc fork handlers; that is fine, as the child
+ * only sets up its environment and calls `exec`.
+ */
+static pid_t clone_into_cgroup(int cgroup_fd)
+{
+#ifdef CLONE_INTO_CGROUP
+    if (clone_into_cgroup_unsupported) return -1;
+    clone_args args{};
+    args.flags = CLONE_INTO_CGROUP;
+    args.exit_signal = SIGCHLD;
+    args.cgroup = static_cast<uint64_t>(cgroup_fd);
+    long child = syscall(SYS_clone3, &args, sizeof(args));
+    if (child != -1) return static_cast<pid_t>(child);
+    // ENOSYS - no clone3 (Linux < 5.3), E2BIG/EINVAL - no CLONE_INTO_CGROUP (Linux < 5.7)
+    if (errno != ENOSYS && errno != E2BIG && errno != EINVAL) CHECK(child);
+    logger_process->debug("CLONE_INTO_CGROUP is not supported ({}), using fork()",
+                          strerror(errno));
+    clone_into_cgroup_unsupported = true;
+#endif
+    return -1;
+}
+
+void Process::exec(bool into_cgroup)
 {
-    // create new process
-    pid = CHECK(fork());
+    // create new process; with the cgroup v2 freezer, it is created directly in our
+    //  cgroup, which is already frozen (see constructor), so it never runs unfrozen
+    pid = cgf || !into_cgroup ? -1 : clone_into_cgroup(cge.get_dir_fd());
+    bool in_cgroup = pid != -1;
+    // otherwise, the child waits until we move it to the frozen cgroup and close the pipe
+    int sync_pipe[2] = { -1, -1 };
+    if (!in_cgroup) {
+        CHECK(pipe2(sync_pipe, O_CLOEXEC));
+        pid = CHECK(fork());
+    }
     system_process_spawned = true;
     killed = false;
+    attach_pending = true;
+    activation_time = activation_time.zero();
+    activation_runs = 0;
 
     // launch new process
     if (pid == 0) {
         // CHILD PROCESS
+        if (!in_cgroup) {
+            close(sync_pipe[1]);
+            char c;
+            // returns 0 (EOF) after the parent closes the pipe
+            while (read(sync_pipe[0], &c, 1) == -1 && errno == EINTR) {}
+            close(sync_pipe[0]);
+        }
         char val[100];
         // pass configuration to the process library
         // passed descriptors are used for communication with the library:
         //  - completed_fd is used to read completion messages from process
         //  - efd_continue is used to signal continuation to process
-        sprintf(val, "%d,%d,%d", completed_w.get_fd(), efd_continue, has_initialization);
+        //  - the shm memfds hold the scheduling info page and the futex page,
+        //    which replaces efd_continue if futex_yield is set
+        sprintf(val,
+                "%d,%d,%d,%d,%d,%d",
+                completed_w.get_fd(),
+                efd_continue,
+                has_initialization,
+                shm.get_info_fd(),
+                futex_yield,
+                shm.get_yield_fd());
         CHECK(setenv("DEMOS_PARAMETERS", val, 1));
+        // the CPUs are restricted by the partition cpuset, not by the affinity of DEmOS
+        if (spawn_affinity) sched_setaffinity(0, spawn_affinity->size(), spawn_affinity->ptr());
         if (working_dir) {
             CHECK(chdir(working_dir->c_str()));
         }
@@ -86,28 +168,67 @@ void Process::exec()
         logger_process->debug(
           "Running '{}' as PID '{}' (partition '{}')", argv, pid, part.get_name());
         child_w.start(pid, 0);
-        // TODO: shouldn't we do this in the child process, so that we know the process
-        //  is frozen before we start the command? as it is now, I think there's a possible
-        //  race condition where the started command could run before we move it into the freezer
-        // add process to cgroup (echo PID > cgroup.procs)
-        cge.add_process(pid);
-        cgf.add_process(pid);
+        if (!in_cgroup) {
+            close(sync_pipe[0]);
+            release_fd = sync_pipe[1];
+        }
         // END PARENT PROCESS
     }
 }
 
-void Process::kill()
+void Process::attach(CgroupCpuset &cpuset)
 {
+    if (!attach_pending) return;
+    attach_pending = false;
+    // add process to cgroups (echo PID > cgroup.procs)
+    if (release_fd != -1) {
+        cge.add_process(pid);
+        if (cgf) cgf->add_process(pid);
+        // let the child continue; it is frozen now
+        close(release_fd);
+        release_fd = -1;
+    }
+    cpuset.add_process(pid);
+}
+
+void Process::kill(bool cgroup_killed)
+{
+    // an explicit kill (e.g. on shutdown) cancels a pending restart
+    restarting = false;
     if (!is_spawned()) return;
-    cgf.freeze();
-    cgf.kill_all();
-    cgf.unfreeze();
+    if (!cgroup_killed && !cge.kill_tree()) {
+        // without `cgroup.kill`, freeze the cgroup first, so that
+        //  the processes cannot fork while we kill them one by one
+        freeze();
+        cge.kill_all();
+    }
+    // processes frozen by the cgroup v1 freezer would not exit until unfrozen
+    unfreeze();
     killed = true;
 }
 
+void Process::freeze()
+{
+    if (cgf) {
+        cgf->freeze();
+    } else {
+        cge.freeze();
+    }
+}
+
+void Process::unfreeze()
+{
+    if (cgf) {
+        cgf->unfreeze();
+    } else {
+        cge.unfreeze();
+    }
+}
+
 void Process::suspend()
 {
-    cgf.freeze();
+    parked = false;
+    freeze();
     if (is_spawned()) {
         TRACE_PROCESS("Suspended process '{}' (partition '{}')", pid, part.get_name());
     }
@@ -119,10 +240,44 @@ void Process::resume()
     TRACE_PROCESS("Resuming process '{}' (partition '{}')", pid, part.get_name());
     uint64_t buf = 1;
     if (demos_completed) {
-        CHECK(write(efd_continue, &buf, sizeof(buf)));
+        if (futex_yield && shm.is_yield_active()) {
+            shm.signal_continue();
+        } else {
+            CHECK(write(efd_continue, &buf, sizeof(buf)));
+        }
         demos_completed = false;
+        // a new activation starts
+        activation_time = activation_time.zero();
+        activation_runs = 0;
+    }
+    if (parked) {
+        // still running since the previous window, no need to touch the freezer
+        parked = false;
+        return;
+    }
+    unfreeze();
+}
+
+void Process::park()
+{
+    ASSERT(is_spawned());
+    TRACE_PROCESS("Parking process '{}' (partition '{}')", pid, part.get_name());
+    parked = true;
+}
+
+void Process::set_affinity(const cpu_set &cpus, bool pin)
+{
+    ASSERT(is_spawned());
+    // sched_setaffinity is used instead of a child cpuset per CPU, as moving a process
+    //  between cgroups is much slower and the process may run on a different CPU in each window
+    if (sched_setaffinity(pid, cpus.size(), cpus.ptr()) == -1 && errno != ESRCH) {
+        // ESRCH = the process already exited, which is handled by `child_w`
+        logger->warn("Cannot set CPU affinity of process '{}' to '{}': {}",
+                     pid,
+                     cpus.as_list(),
+                     strerror(errno));
     }
-    cgf.unfreeze();
+    pinned = pin;
 }
 
 milliseconds Process::get_actual_budget()
@@ -139,12 +294,12 @@ milliseconds Process::get_actual_budget()
 
 bool Process::needs_initialization() const
 {
-    return has_initialization;
+    return has_initialization && !initialized;
 }
 
 bool Process::is_pending() const
 {
-    return is_spawned() && !completed;
+    return is_spawned() && !completed && !restarting;
 }
 
 void Process::mark_completed()
@@ -181,6 +336,98 @@ void Process::reset_budget()
     actual_budget = budget;
 }
 
+void Process::set_budget(milliseconds new_budget, milliseconds budget_jitter)
+{
+    ASSERT(2 * new_budget >= budget_jitter);
+    budget = new_budget;
+    actual_budget = new_budget;
+    configured_budget = new_budget;
+    jitter_distribution_ms = std::uniform_int_distribution<long>(
+      -budget_jitter.count() / 2, budget_jitter.count() - budget_jitter.count() / 2);
+}
+
+void Process::set_adaptive_budget(const std::optional<AdaptiveBudget> &adaptive)
+{
+    if (adaptive && !(exec_time_estimator && adaptive_budget &&
+                      adaptive_budget->quantile == adaptive->quantile)) {
+        exec_time_estimator.emplace(adaptive->quantile);
+    }
+    adaptive_budget = adaptive;
+    // start from the configured budget, until enough execution times are measured
+    budget = actual_budget = configured_budget;
+}
+
+void Process::record_execution_time(std::chrono::nanoseconds exec_time)
+{
+    if (!adaptive_budget) return;
+    exec_time_estimator->add(static_cast<double>(exec_time.count()));
+    // the estimator needs a few samples to settle
+    if (exec_time_estimator->count() < 5) return;
+    auto target = std::chrono::ceil<milliseconds>(std::chrono::duration<double, std::nano>(
+      exec_time_estimator->estimate() * (1 + adaptive_budget->margin)));
+    auto adapted = std::clamp(target, adaptive_budget->min_budget, configured_budget);
+    if (adapted == budget) return;
+    TRACE_PROCESS("Budget of process '{}' adapted from '{} ms' to '{} ms'",
+                  pid,
+                  budget.count(),
+                  adapted.count());
+    // keep the budget shortened by `set_remaining_budget`
+    if (actual_budget == budget) actual_budget = adapted;
+    budget = adapted;
+}
+
+void Process::handle_overrun()
+{
+    overrun_stats.overruns++;
+    overrun_stats.consecutive++;
+    switch (overrun_policy.action) {
+        case OverrunPolicy::Action::carry_on:
+            break;
+        case OverrunPolicy::Action::skip:
+            TRACE_PROCESS("Discarding the activation of process '{}' after an overrun", pid);
+            overrun_stats.skipped++;
+            overrun_stats.consecutive = 0;
+            kill();
+            // set after `kill()`, which clears it; see `Partition::proc_exit_cb`
+            restarting = true;
+            break;
+        case OverrunPolicy::Action::signal:
+            // the processes are frozen, so they receive the signal when they run next time;
+            //  `pid` is only the shell running the command, signal the whole cgroup
+            cge.signal_all(overrun_policy.signal);
+            break;
+        case OverrunPolicy::Action::restart:
+            if (overrun_stats.consecutive < overrun_policy.restart_after) break;
+            logger_process->warn(
+              "Restarting process '{}' after {} consecutive overruns (partition: '{}', cmd: '{}')",
+              pid,
+              overrun_stats.consecutive,
+              part.get_name(),
+              argv);
+            overrun_stats.restarts++;
+            overrun_stats.consecutive = 0;
+            kill();
+            // set after `kill()`, which clears it; see `Partition::proc_exit_cb`
+            restarting = true;
+            break;
+    }
+}
+
+void Process::respawn(CgroupCpuset &cpuset)
+{
+    ASSERT(restarting && !is_spawned());
+    restarting = false;
+    // `kill()` unfroze the cgroup, the new process must not run until it is scheduled
+    suspend();
+    demos_completed = false;
+    pinned = false;
+    // the cgroup was killed through `cgroup.kill`; on some kernels (seen on 6.18), every
+    //  process later created in it with `CLONE_INTO_CGROUP` is killed immediately, while
+    //  moving a forked process there works, so the process is moved after `fork()` instead
+    exec(false);
+    attach(cpuset);
+}
+
 /** Called when the cgroup is empty and we want to signal it to the parent partition. */
 void Process::handle_end()
 {
@@ -224,6 +471,15 @@ void Process::populated_cb(bool populated)
     }
 }
 
+/** Called when the cgroup v2 freezer confirms that a requested freeze took effect. */
+void Process::frozen_cb(std::chrono::nanoseconds latency)
+{
+    freeze_stats.count++;
+    freeze_stats.total += latency;
+    freeze_stats.max = std::max(freeze_stats.max, latency);
+    TRACE_PROCESS("Process '{}' frozen after {} µs", pid, latency.count() / 1000.0);
+}
+
 /** Called when our spawned child process terminates. */
 void Process::child_terminated_cb(ev::child &w, [[maybe_unused]] int revents)
 {
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <csignal>
 #include <fcntl.h>
 #include <filesystem>
 #include <iostream>
@@ -11,6 +12,10 @@
 #include "cgroup.hpp"
 #include "cpufreq_policy.hpp"
 #include "evfd.hpp"
+#include "lib/assert.hpp"
+#include "lib/cpu_set.hpp"
+#include "process_shm.hpp"
+#include "quantile_estimator.hpp"
 #include "timerfd.hpp"
 
 class Partition;
@@ -34,18 +39,38 @@ public:
             std::chrono::milliseconds budget,
             std::chrono::milliseconds budget_jitter,
             std::optional<CpuFrequencyHz> req_freq,
-            bool has_initialization = false);
+            bool has_initialization = false,
+            bool futex_yield = false);
 
-    /** Spawns the underlying system process. */
-    void exec();
+    /**
+     * Spawns the underlying system process. The process does not run
+     * until `attach(...)` is called (and it is unfrozen).
+     *
+     * @param into_cgroup - false to always spawn the process by `fork()` and move it to its
+     *  cgroups in `attach(...)`, instead of creating it directly in its cgroup
+     */
+    void exec(bool into_cgroup = true);
+
+    /**
+     * Moves the process spawned by `exec()` into its cgroups, unless it was already
+     * created there, and adds it to the partition `cpuset`. Does nothing if there is
+     * no such process.
+     *
+     * Separate from `exec()`, so that processes can be spawned and moved to cgroups
+     * in batches (see `PartitionManager::create_processes`).
+     */
+    void attach(CgroupCpuset &cpuset);
 
     /**
      * Kills the process, and all children in its cgroup.
      *
      * Does not wait for exit, you should wait for the exit of all processes
      * on the parent partition using `set_empty_cb`.
+     *
+     * @param cgroup_killed - true if the processes were already killed through
+     *  `cgroup.kill` of the parent partition (see `Partition::kill_all`)
      */
-    void kill();
+    void kill(bool cgroup_killed = false);
 
     /**
      * Suspends this process and all children.
@@ -55,8 +80,16 @@ public:
     /**
      * Resumes this process and all children.
      * Internally, this unfreezes the underlying cgroup.
+     *
+     * If the process is parked, it is still running and only the parked flag is cleared.
      */
     void resume();
+    /**
+     * Marks the process as suspended, but keeps it running. Used at window boundaries
+     * when the process may continue in the next window; if it does not, `suspend()`
+     * must be called after the next window starts.
+     */
+    void park();
 
     /**
      * Sets budget for the next window.
@@ -69,18 +102,226 @@ public:
     /** Resets next budget to the default value. */
     void reset_budget();
 
+    /**
+     * Changes the budget and its jitter, e.g. after the configuration is reloaded.
+     * Any shortened budget (see `set_remaining_budget`) is discarded.
+     */
+    void set_budget(std::chrono::milliseconds new_budget,
+                    std::chrono::milliseconds budget_jitter);
+
+    /**
+     * Returns true if the process was created with given parameters; unlike the budget,
+     * these cannot be changed without restarting the process.
+     */
+    [[nodiscard]] bool has_definition(const std::string &argv_,
+                                      const std::optional<std::filesystem::path> &working_dir_,
+                                      std::optional<CpuFrequencyHz> req_freq,
+                                      bool has_initialization_,
+                                      bool futex_yield_) const
+    {
+        return argv == argv_ && working_dir == working_dir_ && requested_frequency == req_freq &&
+               has_initialization == has_initialization_ && futex_yield == futex_yield_;
+    }
+
+    /**
+     * Settings of a budget adapted to the measured execution time of the process (only
+     * measured when it runs in an SC partition): the budget is set to the `quantile`
+     * of the execution times plus the relative `margin`, but at least `min_budget`
+     * and at most the configured budget.
+     */
+    struct AdaptiveBudget
+    {
+        double quantile;
+        double margin;
+        std::chrono::milliseconds min_budget;
+    };
+    /** Enables or disables (nullopt) adaptive budget; the collected statistics are kept. */
+    void set_adaptive_budget(const std::optional<AdaptiveBudget> &adaptive);
+    /**
+     * Records the execution time of a whole activation (see `get_activation_time()`)
+     * and adapts the budget, if enabled. `exec_time` is not scaled by the CPU frequency
+     * (see `PowerPolicy::get_budget_scale`).
+     */
+    void record_execution_time(std::chrono::nanoseconds exec_time);
+
     [[nodiscard]] std::chrono::milliseconds get_actual_budget();
+    /** Current budget, without jitter; with adaptive budget, this is the adapted budget. */
+    [[nodiscard]] std::chrono::milliseconds get_budget() const { return budget; }
     [[nodiscard]] pid_t get_pid() const;
     [[nodiscard]] bool needs_initialization() const;
+    /** Called after the process finished its initialization (or exited during it). */
+    void mark_initialized() { initialized = true; }
     [[nodiscard]] bool is_spawned() const;
     [[nodiscard]] bool is_pending() const;
+    [[nodiscard]] bool is_parked() const { return parked; }
+
+    /**
+     * Sets the CPU affinity of the process to `cpus`, which must be a subset of the partition
+     * cpuset. Only the main thread is affected immediately; threads and children created
+     * later inherit the affinity.
+     *
+     * @param pin - true if `cpus` is narrower than the partition cpuset, see `is_pinned()`
+     */
+    void set_affinity(const cpu_set &cpus, bool pin);
+    /** True if the affinity was narrowed by `set_affinity(...)`. */
+    [[nodiscard]] bool is_pinned() const { return pinned; }
+    /**
+     * Sets the CPU affinity of processes spawned from now on (on restart or configuration
+     * reload), which would otherwise inherit the affinity of DEmOS (see `demos_cpu`).
+     * Must be called before the affinity of DEmOS is changed, with its previous affinity.
+     */
+    static void set_spawn_affinity(const cpu_set &cpus);
+
+    struct FreezeStats
+    {
+        uint64_t count = 0;
+        std::chrono::nanoseconds total{ 0 };
+        std::chrono::nanoseconds max{ 0 };
+    };
+    /** Confirmed freeze latencies, only measured with the cgroup v2 freezer. */
+    [[nodiscard]] const FreezeStats &get_freeze_stats() const { return freeze_stats; }
+
+    struct RunStats
+    {
+        /** Total time the process was scheduled to run. */
+        std::chrono::nanoseconds consumed{ 0 };
+        uint64_t runs = 0;
+        /** Number of runs that ended because the process exhausted its budget. */
+        uint64_t budget_exhausted = 0;
+    };
+    [[nodiscard]] const RunStats &get_run_stats() const { return run_stats; }
+    /**
+     * Called by Slice when the process stops running (or is parked). `budget_scale` is
+     * the budget scale during the run (see `PowerPolicy::get_budget_scale`).
+     */
+    void account_run(std::chrono::nanoseconds consumed, double budget_scale, bool budget_exhausted)
+    {
+        run_stats.consumed += consumed;
+        run_stats.runs++;
+        if (budget_exhausted) run_stats.budget_exhausted++;
+        auto consumed_us = std::chrono::duration_cast<std::chrono::microseconds>(consumed);
+        pass += static_cast<uint64_t>(consumed_us.count()) * stride;
+        activation_time +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(consumed / budget_scale);
+        activation_runs++;
+    }
+
+    /**
+     * Execution time of the current activation, i.e. of its runs that already ended;
+     * not scaled by the CPU frequency. An activation starts when the process is spawned,
+     * or resumed after it completed, and may span multiple runs if it overran its budget
+     * or the window.
+     */
+    [[nodiscard]] std::chrono::nanoseconds get_activation_time() const { return activation_time; }
+    /** Number of runs of the current activation that already ended. */
+    [[nodiscard]] unsigned get_activation_runs() const { return activation_runs; }
+
+    /** Largest weight, so that the stride is at least 1. */
+    static constexpr unsigned max_weight = 1U << 16;
+    /**
+     * Sets the weight of the process in a BE partition with stride scheduling
+     * (see `Partition::set_stride_scheduling`); must be between 1 and `max_weight`.
+     */
+    void set_weight(unsigned new_weight)
+    {
+        ASSERT(new_weight >= 1 && new_weight <= max_weight);
+        weight = new_weight;
+        stride = max_weight / new_weight;
+    }
+    [[nodiscard]] unsigned get_weight() const { return weight; }
+    /**
+     * Virtual time of the process for stride scheduling, i.e. the time it ran (in µs)
+     * multiplied by its stride, which is inversely proportional to its weight.
+     */
+    [[nodiscard]] uint64_t get_pass() const { return pass; }
+    void set_pass(uint64_t new_pass) { pass = new_pass; }
+
+    /**
+     * What happens when a run of the process in an SC partition ends before it completes,
+     * i.e. its budget or the window ends. By default, the process continues from where it
+     * was stopped in its next run.
+     */
+    struct OverrunPolicy
+    {
+        enum class Action
+        {
+            /** Only count the overrun. */
+            carry_on,
+            /**
+             * Discard the rest of the activation, so that the process never resumes it:
+             * kill the process and spawn it again (without initialization) before its next
+             * activation. It does not run in activations that start before it is spawned.
+             */
+            skip,
+            /**
+             * Send `signal` to all processes in the cgroup of the process, which receive it
+             * when they run next time. The default action of the default `SIGXCPU` is
+             * to terminate the process (with a core dump), so the process must handle it.
+             */
+            signal,
+            /**
+             * Kill and spawn the process again after `restart_after` consecutive overruns,
+             * like `skip`; the process carries on after fewer overruns.
+             */
+            restart,
+        };
+        Action action = Action::carry_on;
+        int signal = SIGXCPU;
+        unsigned restart_after = 1;
+    };
+    void set_overrun_policy(const OverrunPolicy &policy) { overrun_policy = policy; }
+    [[nodiscard]] const OverrunPolicy &get_overrun_policy() const { return overrun_policy; }
+
+    /**
+     * Called by Slice after a run in an SC partition ended without completion (and the
+     * process was stopped or parked); counts the overrun and applies the overrun policy.
+     */
+    void handle_overrun();
+    /** Called by Slice when the process completes in an SC partition. */
+    void clear_consecutive_overruns() { overrun_stats.consecutive = 0; }
+
+    struct OverrunStats
+    {
+        uint64_t overruns = 0;
+        /** Overruns since the last completion (or restart). */
+        uint64_t consecutive = 0;
+        /** Activations discarded by `OverrunPolicy::Action::skip`. */
+        uint64_t skipped = 0;
+        uint64_t restarts = 0;
+    };
+    [[nodiscard]] const OverrunStats &get_overrun_stats() const { return overrun_stats; }
+
+    /** True while the process is killed to be spawned again by `respawn(...)`. */
+    [[nodiscard]] bool is_restarting() const { return restarting; }
+    /**
+     * Spawns the process again after it exited due to a restart, frozen, directly
+     * in its cgroups (i.e. `exec()` followed by `attach(...)`).
+     */
+    void respawn(CgroupCpuset &cpuset);
 
     void mark_completed();
     void mark_uncompleted();
 
+    /**
+     * Publishes the scheduling state to the process (see `demos_get_sched_info()`).
+     *
+     * @param budget_deadline - end of the current budget, or `time_point{}`
+     *  if the process is not running
+     */
+    void publish_sched_info(ProcessShm::time_point budget_deadline,
+                            ProcessShm::time_point window_end,
+                            uint64_t major_frame,
+                            uint32_t window_index)
+    {
+        shm.publish_info(
+          budget_deadline, window_end, major_frame, window_index, overrun_stats.overruns);
+    }
+
     Partition &part;
     const std::optional<CpuFrequencyHz> requested_frequency;
     const std::string argv;
+    /** ID of this process in the schedule trace. */
+    const uint32_t trace_id;
 
 private:
     std::uniform_int_distribution<long> jitter_distribution_ms;
@@ -89,16 +330,37 @@ private:
     ev::evfd completed_w{ loop };
     ev::child child_w{ loop };
     int efd_continue; // new period eventfd
+    ProcessShm shm{};
+    /** If true, the process library may use the futex in `shm` instead of `efd_continue`. */
+    const bool futex_yield;
 
     CgroupEvents cge;
-    CgroupFreezer cgf;
+    /** Only used on systems without the cgroup v2 freezer, otherwise `cge` is frozen directly. */
+    std::optional<CgroupFreezer> cgf{};
+    FreezeStats freeze_stats{};
+    RunStats run_stats{};
+    std::chrono::nanoseconds activation_time{ 0 };
+    unsigned activation_runs = 0;
+    unsigned weight = 1;
+    uint64_t stride = max_weight;
+    uint64_t pass = 0;
+    OverrunPolicy overrun_policy{};
+    OverrunStats overrun_stats{};
+    bool restarting = false;
 
     const std::optional<std::filesystem::path> working_dir;
-    const std::chrono::milliseconds budget;
+    std::chrono::milliseconds budget;
     std::chrono::milliseconds actual_budget;
+    /** The budget from the configuration, the ceiling of the adaptive budget. */
+    std::chrono::milliseconds configured_budget;
+    std::optional<AdaptiveBudget> adaptive_budget{};
+    std::optional<P2QuantileEstimator> exec_time_estimator{};
     const bool has_initialization;
+    bool initialized = false;
     bool completed = false;
     bool demos_completed = false;
+    bool parked = false;
+    bool pinned = false;
     // cannot be replaced by `pid >= 0`, as we want
     //  to keep pid even after process exits, to be
     //  able to correctly handle some delayed events
@@ -114,10 +376,17 @@ private:
      * Used to print a warning when process ends unexpectedly.
      */
     bool killed = false;
+    /** Set by `exec()` until the process is moved to its cgroups by `attach(...)`. */
+    bool attach_pending = false;
+    /** Write end of the pipe the child waits on until `attach(...)`, or -1. */
+    int release_fd = -1;
     pid_t pid = -1;
 
+    void freeze();
+    void unfreeze();
     void handle_end();
     void populated_cb(bool populated);
+    void frozen_cb(std::chrono::nanoseconds latency);
     void completed_cb();
     void child_terminated_cb(ev::child &w, [[maybe_unused]] int revents);
 };
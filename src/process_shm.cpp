@@ -0,0 +1,102 @@
+#include "process_shm.hpp"
+#include "lib/check_lib.hpp"
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Creates a sealable memfd of `size` bytes, which cannot be resized afterwards,
+ * and maps it read-write into `mem`. Returns the descriptor.
+ */
+static int create_shared_page(const char *name, size_t size, void *&mem)
+{
+    // not MFD_CLOEXEC, the descriptor is passed to the spawned process
+    int fd = CHECK(memfd_create(name, MFD_ALLOW_SEALING));
+    // the process must not shrink the memfd, our accesses to the mapping would fail with SIGBUS
+    if (ftruncate(fd, size) == -1 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) == -1 ||
+        (mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        int e = errno;
+        close(fd);
+        throw IOError(e, "Failed to map the memory shared with the process");
+    }
+    return fd;
+}
+
+ProcessShm::ProcessShm()
+    : page_size(sysconf(_SC_PAGESIZE))
+{
+    void *mem = nullptr;
+    info_fd = create_shared_page("demos-info", page_size, mem);
+    info = static_cast<demos_sch_info *>(mem);
+    try {
+        seal_info_page();
+        yield_fd = create_shared_page("demos-yield", page_size, mem);
+        yield = static_cast<demos_sch_yield *>(mem);
+    } catch (...) {
+        munmap(info, page_size);
+        close(info_fd);
+        throw;
+    }
+}
+
+ProcessShm::~ProcessShm()
+{
+    munmap(info, page_size);
+    munmap(yield, page_size);
+    close(info_fd);
+    close(yield_fd);
+}
+
+void ProcessShm::seal_info_page()
+{
+    // our writable mapping is not affected by the seal
+    if (fcntl(info_fd, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) == 0) return;
+    // kernels before 5.1 do not support F_SEAL_FUTURE_WRITE; pass a read-only descriptor
+    //  instead, which cannot be mapped writable (but the process may reopen it through /proc)
+    if (errno != EINVAL) throw IOError(errno, "Failed to seal the scheduling info page");
+    int ro_fd = CHECK(open(("/proc/self/fd/" + std::to_string(info_fd)).c_str(), O_RDONLY));
+    close(info_fd);
+    info_fd = ro_fd;
+}
+
+static uint64_t to_ns(ProcessShm::time_point tp)
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(tp.time_since_epoch()).count();
+}
+
+void ProcessShm::publish_info(time_point budget_deadline,
+                              time_point window_end,
+                              uint64_t major_frame,
+                              uint32_t window_index,
+                              uint64_t overruns)
+{
+    // seqlock write side; we are the only writer
+    __atomic_store_n(&info->seq, info->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&info->window_index, window_index, __ATOMIC_RELAXED);
+    __atomic_store_n(&info->major_frame, major_frame, __ATOMIC_RELAXED);
+    __atomic_store_n(&info->budget_deadline_ns,
+                     budget_deadline == time_point{} ? 0 : to_ns(budget_deadline),
+                     __ATOMIC_RELAXED);
+    __atomic_store_n(&info->window_end_ns, to_ns(window_end), __ATOMIC_RELAXED);
+    __atomic_store_n(&info->overruns, overruns, __ATOMIC_RELAXED);
+    __atomic_store_n(&info->seq, info->seq + 1, __ATOMIC_RELEASE);
+}
+
+bool ProcessShm::is_yield_active() const
+{
+    return __atomic_load_n(&yield->active, __ATOMIC_SEQ_CST);
+}
+
+void ProcessShm::signal_continue()
+{
+    // pairs with `wait_for_continue` in the process library
+    __atomic_fetch_add(&yield->continue_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&yield->waiting, __ATOMIC_SEQ_CST)) {
+        CHECK(syscall(SYS_futex, &yield->continue_seq, FUTEX_WAKE, 1, nullptr, nullptr, 0));
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "demos-sch-shm.h"
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Memory shared with the process library (see `demos-sch-shm.h`).
+ *
+ * The info page publishes the scheduling state of the process, which the process
+ * can read without a syscall using `demos_get_sched_info()`. It is in a separate memfd,
+ * which the process cannot write to.
+ *
+ * The yield page is used to signal continuation through a futex instead of an eventfd.
+ * It is only used after the process library activates it; processes which do not
+ * use the library (or use an older version) keep using the eventfd path.
+ */
+class ProcessShm
+{
+public:
+    using time_point = std::chrono::steady_clock::time_point;
+
+    ProcessShm();
+    ~ProcessShm();
+
+    ProcessShm(const ProcessShm &) = delete;
+    const ProcessShm &operator=(const ProcessShm &) = delete;
+
+    /** memfd with the info page, inherited by the spawned process. */
+    [[nodiscard]] int get_info_fd() const { return info_fd; }
+    /** memfd with the yield page, inherited by the spawned process. */
+    [[nodiscard]] int get_yield_fd() const { return yield_fd; }
+
+    /**
+     * Updates the info page.
+     *
+     * @param budget_deadline - end of the current budget, or `time_point{}`
+     *  if the process is not scheduled
+     */
+    void publish_info(time_point budget_deadline,
+                      time_point window_end,
+                      uint64_t major_frame,
+                      uint32_t window_index,
+                      uint64_t overruns);
+
+    /** True if the process library mapped the yield page and waits on the futex. */
+    [[nodiscard]] bool is_yield_active() const;
+
+    /**
+     * Lets the process continue from `demos_completed()`. FUTEX_WAKE is only called
+     * if the process is actually waiting.
+     */
+    void signal_continue();
+
+private:
+    size_t page_size;
+    int info_fd = -1;
+    int yield_fd = -1;
+    demos_sch_info *info = nullptr;
+    demos_sch_yield *yield = nullptr;
+
+    void seal_info_page();
+};
@@ -0,0 +1,51 @@
+#include "tests/acutest.h"
+
+#include "process_shm.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+
+static void test_info_page_read_only()
+{
+    ProcessShm shm;
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    auto t = std::chrono::steady_clock::time_point{ std::chrono::seconds(1) };
+    shm.publish_info(t, t, 3, 1, 0);
+
+    // what the process library does
+    void *ro = mmap(nullptr, page_size, PROT_READ, MAP_SHARED, shm.get_info_fd(), 0);
+    TEST_ASSERT(ro != MAP_FAILED);
+    auto *info = static_cast<const demos_sch_info *>(ro);
+    TEST_CHECK(info->major_frame == 3);
+    TEST_CHECK(info->window_index == 1);
+    TEST_CHECK(info->seq == 2);
+
+    // the process must not be able to modify the info page, or resize it under our mapping
+    TEST_CHECK(mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm.get_info_fd(), 0) ==
+               MAP_FAILED);
+    TEST_CHECK(write(shm.get_info_fd(), "x", 1) == -1);
+    TEST_CHECK(ftruncate(shm.get_info_fd(), 0) == -1);
+    munmap(ro, page_size);
+}
+
+static void test_yield_page()
+{
+    ProcessShm shm;
+    auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    void *rw = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm.get_yield_fd(), 0);
+    TEST_ASSERT(rw != MAP_FAILED);
+    auto *yield = static_cast<demos_sch_yield *>(rw);
+    TEST_CHECK(!shm.is_yield_active());
+    yield->active = 1;
+    TEST_CHECK(shm.is_yield_active());
+    shm.signal_continue();
+    TEST_CHECK(yield->continue_seq == 1);
+
+    TEST_CHECK(ftruncate(shm.get_yield_fd(), 0) == -1);
+    munmap(rw, page_size);
+}
+
+TEST_LIST = {
+    { "info_page_read_only", test_info_page_read_only },
+    { "yield_page", test_yield_page },
+    { nullptr, nullptr },
+};
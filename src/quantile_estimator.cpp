@@ -0,0 +1,70 @@
+#include "quantile_estimator.hpp"
+#include <algorithm>
+#include <cmath>
+
+P2QuantileEstimator::P2QuantileEstimator(double p)
+    : p(p)
+    , pos{ 1, 2, 3, 4, 5 }
+    , desired{ 1, 1 + 2 * p, 1 + 4 * p, 3 + 2 * p, 5 }
+    , increment{ 0, p / 2, p, (1 + p) / 2, 1 }
+{}
+
+void P2QuantileEstimator::add(double x)
+{
+    if (n < MARKERS) {
+        height[n++] = x;
+        if (n == MARKERS) std::sort(height.begin(), height.end());
+        return;
+    }
+
+    // find the cell containing x, extending the extreme markers if needed
+    int k;
+    if (x < height[0]) {
+        height[0] = x;
+        k = 0;
+    } else if (x >= height[MARKERS - 1]) {
+        height[MARKERS - 1] = x;
+        k = MARKERS - 2;
+    } else {
+        k = 0;
+        while (x >= height[k + 1]) k++;
+    }
+    for (int i = k + 1; i < MARKERS; i++) pos[i]++;
+    for (int i = 0; i < MARKERS; i++) desired[i] += increment[i];
+    n++;
+
+    // move the middle markers towards their desired positions
+    for (int i = 1; i < MARKERS - 1; i++) {
+        double d = desired[i] - pos[i];
+        if ((d >= 1 && pos[i + 1] - pos[i] > 1) || (d <= -1 && pos[i - 1] - pos[i] < -1)) {
+            int ds = d > 0 ? 1 : -1;
+            double h = parabolic(i, ds);
+            // fall back to linear interpolation if the parabola is not monotonic
+            height[i] = height[i - 1] < h && h < height[i + 1] ? h : linear(i, ds);
+            pos[i] += ds;
+        }
+    }
+}
+
+double P2QuantileEstimator::parabolic(int i, double d) const
+{
+    return height[i] +
+           d / (pos[i + 1] - pos[i - 1]) *
+             ((pos[i] - pos[i - 1] + d) * (height[i + 1] - height[i]) / (pos[i + 1] - pos[i]) +
+              (pos[i + 1] - pos[i] - d) * (height[i] - height[i - 1]) / (pos[i] - pos[i - 1]));
+}
+
+double P2QuantileEstimator::linear(int i, int d) const
+{
+    return height[i] + d * (height[i + d] - height[i]) / (pos[i + d] - pos[i]);
+}
+
+double P2QuantileEstimator::estimate() const
+{
+    if (n >= MARKERS) return height[2];
+    if (n == 0) return 0;
+    std::array<double, MARKERS> sorted = height;
+    std::sort(sorted.begin(), sorted.begin() + static_cast<long>(n));
+    auto rank = static_cast<uint64_t>(std::ceil(p * static_cast<double>(n)));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
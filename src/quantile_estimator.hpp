@@ -0,0 +1,47 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+/**
+ * Streaming estimator of a single quantile, using the P² algorithm (R. Jain and I. Chlamtac,
+ * "The P² algorithm for dynamic calculation of quantiles and histograms without storing
+ * observations", 1985).
+ *
+ * Keeps 5 markers whose heights approximate the minimum, the `p/2`, `p` and `(1+p)/2`
+ * quantiles and the maximum; the markers are adjusted by piecewise-parabolic interpolation
+ * with each observation. Uses constant memory and does not allocate, so it can be
+ * updated while the scheduler is running.
+ */
+class P2QuantileEstimator
+{
+public:
+    /** @param p - the estimated quantile, in (0, 1) */
+    explicit P2QuantileEstimator(double p);
+
+    void add(double x);
+
+    [[nodiscard]] uint64_t count() const { return n; }
+    /**
+     * Current estimate of the quantile; with less than 5 observations, the quantile of
+     * the observations so far. Zero if there are no observations.
+     */
+    [[nodiscard]] double estimate() const;
+
+private:
+    static constexpr int MARKERS = 5;
+
+    double p;
+    uint64_t n = 0;
+    /** Marker heights; before there are 5 observations, the observations themselves. */
+    std::array<double, MARKERS> height{};
+    /** Actual marker positions (1-based ranks). */
+    std::array<double, MARKERS> pos{};
+    /** Desired marker positions. */
+    std::array<double, MARKERS> desired{};
+    /** Increments of the desired positions with each observation. */
+    std::array<double, MARKERS> increment{};
+
+    [[nodiscard]] double parabolic(int i, double d) const;
+    [[nodiscard]] double linear(int i, int d) const;
+};
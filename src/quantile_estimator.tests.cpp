@@ -0,0 +1,46 @@
+#include "tests/acutest.h"
+
+#include "quantile_estimator.hpp"
+#include <random>
+
+static void test_few_samples()
+{
+    P2QuantileEstimator q(0.5);
+    TEST_CHECK(q.estimate() == 0);
+    q.add(3);
+    q.add(1);
+    q.add(2);
+    TEST_CHECK(q.count() == 3);
+    TEST_CHECK(q.estimate() == 2);
+}
+
+static void test_uniform()
+{
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<double> dist(0, 100);
+    for (double p : { 0.5, 0.9, 0.99 }) {
+        P2QuantileEstimator q(p);
+        for (int i = 0; i < 10000; i++) q.add(dist(gen));
+        TEST_CHECK(std::abs(q.estimate() - 100 * p) < 2);
+        TEST_MSG("p=%f, estimate=%f", p, q.estimate());
+    }
+}
+
+static void test_shift()
+{
+    // the estimate follows a persistent change of the distribution
+    P2QuantileEstimator q(0.9);
+    for (int i = 0; i < 100; i++) q.add(10 + i % 10);
+    TEST_CHECK(q.estimate() >= 17 && q.estimate() <= 19);
+    TEST_MSG("estimate=%f", q.estimate());
+    for (int i = 0; i < 1000; i++) q.add(30 + i % 10);
+    TEST_CHECK(q.estimate() >= 37 && q.estimate() <= 39);
+    TEST_MSG("estimate=%f", q.estimate());
+}
+
+TEST_LIST = {
+    { "few_samples", test_few_samples },
+    { "uniform", test_uniform },
+    { "shift", test_shift },
+    { nullptr, nullptr },
+};
@@ -1,34 +1,9 @@
 #include "slice.hpp"
 #include "log.hpp"
 #include "power_policy/_power_policy.hpp"
+#include "trace.hpp"
 #include <lib/assert.hpp>
-#include <fstream>
 
-time_point Slice::start_time;
-
-static class ScheduleLogger
-{
-public:
-    ScheduleLogger()
-    {
-        const char *log = getenv("DEMOS_SCHEDULE_LOG");
-        if (!log) return;
-        if constexpr (enabled) {
-            schedule_out.open(log, std::ios_base::trunc);
-        } else {
-            throw runtime_error(
-              "DEMOS_SCHEDULE_LOG env. variable is not supported in release build");
-        }
-    }
-    void log(const std::string &msg)
-    {
-        if constexpr (enabled) schedule_out << msg;
-    }
-
-private:
-    static constexpr bool enabled = IF_DEBUG(true, false);
-    std::ofstream schedule_out{};
-} schedule_logger;
 
 /*
 TODO: I think there is a subtle race condition here, where
@@ -38,34 +13,72 @@ TODO: I think there is a subtle race condition here, where
  window will arrive to the new window, and the process will be immediately
  blocked and not run at all during next window.
  */
-Slice::Slice(ev::loop_ref loop,
-             PowerPolicy &power_policy,
+Slice::Slice(PowerPolicy &power_policy,
              std::function<void(Slice &, time_point)> sc_done_cb,
              Partition *sc,
              Partition *be,
              std::optional<CpuFrequencyHz> req_freq,
-             cpu_set cpus)
+             cpu_set cpus,
+             bool parallel_be)
     : sc(sc)
     , be(be)
     , cpus(std::move(cpus))
     , requested_frequency(req_freq)
+    , parallel_be(parallel_be && be)
     , power_policy{ power_policy }
     , sc_done_cb(std::move(sc_done_cb))
-    , timer(loop)
-    , completion_cb_cached{ [this](Process &) { schedule_next(std::chrono::steady_clock::now()); } }
+    , trace_id(schedule_trace.register_subject(this->cpus.as_list()))
+    , completion_cb_cached{ [this](Process &proc) {
+        auto now = std::chrono::steady_clock::now();
+        schedule_trace.record(TraceEvent::process_completed, now, proc.trace_id, trace_id);
+        this->power_policy.on_process_completed(proc);
+        for (auto &lane : lanes) {
+            if (lane.process != &proc) continue;
+            schedule_next(lane, now);
+            return;
+        }
+    } }
 {
-    timer.set([this] { schedule_next(timeout); });
-    // set lower than default priority; this makes this timeout trigger
-    //  after MajorFrame window timer in case a process runs out of budget
-    //  at the same moment as window end
-    timer.priority = -1;
+    if (!this->parallel_be) {
+        lanes.emplace_back();
+        return;
+    }
+    lanes.reserve(this->cpus.count());
+    for (unsigned cpu = 0; cpu < cpu_set::max_cpus; cpu++) {
+        if (!this->cpus.is_set(cpu)) continue;
+        lanes.emplace_back().cpu.set(cpu);
+    }
 }
 
-bool Slice::load_next_process(time_point current_time)
+void Slice::bind_timer(TimerDispatcher &timer_dispatcher)
 {
-    ASSERT(running_process == nullptr);
-    running_process = running_partition->seek_pending_process();
-    if (running_process) {
+    dispatcher = &timer_dispatcher;
+    // `lanes` is not resized after construction, so the references stay valid
+    for (auto &lane : lanes) {
+        lane.timer_slot = dispatcher->add_slot([this, &lane] {
+            schedule_trace.record(
+              TraceEvent::budget_exhausted, lane.timeout, lane.process->trace_id, trace_id);
+            schedule_next(lane, lane.timeout, true);
+        });
+    }
+}
+
+bool Slice::is_running(const Process &proc) const
+{
+    for (auto &lane : lanes) {
+        if (lane.process == &proc) return true;
+    }
+    return false;
+}
+
+bool Slice::load_next_process(Lane &lane, time_point current_time)
+{
+    ASSERT(lane.process == nullptr);
+    lane.process = lanes.size() == 1
+                     ? running_partition->seek_pending_process()
+                     : running_partition->seek_pending_process(
+                         [this](const Process &p) { return is_running(p); });
+    if (lane.process) {
         return true;
     }
     // no process found, we're done
@@ -76,49 +89,114 @@ bool Slice::load_next_process(time_point current_time)
     return false;
 }
 
-/** Finds and starts next unfinished process from current_partition. */
-void Slice::start_next_process(time_point current_time)
+/** Finds and starts next unfinished process from current_partition in `lane`. */
+void Slice::start_next_process(Lane &lane, time_point current_time)
 {
-    if (!load_next_process(current_time)) {
+    if (!load_next_process(lane, current_time)) {
         return;
     }
 
+    Process *running_process = lane.process;
     auto budget = running_process->get_actual_budget();
     if (budget == budget.zero()) {
         // if 2 * budget == jitter, the budget will occasionally be zero
         //  this may simulate a process that occasionally has no work to do
         TRACE("Skipping process with empty effective budget");
         running_process->mark_completed();
-        running_process = nullptr;
-        return start_next_process(current_time);
+        lane.process = nullptr;
+        return start_next_process(lane, current_time);
     }
 
-    using namespace std::chrono;
-    schedule_logger.log(fmt::format("{:6}: cpus={} cmd='{}' budget={}\n",
-                                    duration_cast<milliseconds>(current_time - start_time).count(),
-                                    cpus.as_list(),
-                                    running_process->argv,
-                                    budget.count()));
+    schedule_trace.record(TraceEvent::process_resume,
+                          current_time,
+                          running_process->trace_id,
+                          trace_id,
+                          budget.count());
     TRACE("Running process '{}' for '{} milliseconds'", running_process->get_pid(), budget.count());
+    // a parked process is still running from the previous window, and the power policy
+    //  was not notified about its end, so we skip the start notification as well
+    bool continued = running_process->is_parked();
+    if (!continued && predecessor) {
+        // a different process runs first, make sure the one parked in the previous window
+        //  does not run in parallel with it
+        predecessor->finish_parking();
+    }
+    // pinned while still frozen, so that it never runs on the CPU of another lane
+    if (parallel_be && running_partition == be) {
+        running_process->set_affinity(lane.cpu, true);
+    } else if (running_process->is_pinned()) {
+        running_process->set_affinity(cpus, false);
+    }
     running_process->resume();
-    timeout = current_time + budget;
+    // FIXME: it would probably make more sense to call this inside `resume()`
+    // called before the budget is scaled, as the policy may change the frequency here
+    if (!continued) power_policy.on_process_start(*running_process);
+    lane.run_start = current_time;
+    lane.budget_scale = power_policy.get_budget_scale(cpus);
+    lane.timeout = current_time + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                    budget * lane.budget_scale);
     // if budget was shortened in previous window, this resets it back to full length
     running_process->reset_budget();
-    timer.start(timeout);
-    // FIXME: it would probably make more sense to call this inside `resume()`
-    power_policy.on_process_start(*running_process);
+    dispatcher->arm(lane.timer_slot, lane.timeout);
+    publish_sched_info(*running_process, lane.timeout);
 }
 
-void Slice::stop_current_process(bool mark_completed)
+void Slice::stop_current_process(Lane &lane,
+                                 time_point current_time,
+                                 bool mark_completed,
+                                 bool budget_exhausted)
 {
+    Process *running_process = lane.process;
     ASSERT(running_process != nullptr);
+    running_process->account_run(
+      current_time - lane.run_start, lane.budget_scale, budget_exhausted);
     // this way, the process will run a bit longer
     //  if this call takes a long time to complete
     power_policy.on_process_end(*running_process);
-    timer.stop();
+    dispatcher->disarm(lane.timer_slot);
     running_process->suspend();
+    schedule_trace.record(TraceEvent::process_suspend,
+                          std::chrono::steady_clock::time_point{},
+                          running_process->trace_id,
+                          trace_id);
+    publish_sched_info(*running_process, {});
     if (mark_completed) running_process->mark_completed();
-    running_process = nullptr;
+    lane.process = nullptr;
+}
+
+void Slice::park_current_process(Lane &lane, time_point current_time)
+{
+    ASSERT(lane.process != nullptr);
+    ASSERT(parked_process == nullptr);
+    // if the process continues, the next run is accounted from the start of the next window
+    lane.process->account_run(current_time - lane.run_start, lane.budget_scale, false);
+    dispatcher->disarm(lane.timer_slot);
+    lane.process->park();
+    parked_process = lane.process;
+    lane.process = nullptr;
+}
+
+void Slice::finish_parking()
+{
+    if (!parked_process) return;
+    if (parked_process->is_parked()) {
+        // the process was not resumed in the next window, freeze it now
+        power_policy.on_process_end(*parked_process);
+        parked_process->suspend();
+        publish_sched_info(*parked_process, {});
+    }
+    parked_process = nullptr;
+}
+
+void Slice::publish_sched_info(Process &proc, time_point budget_deadline)
+{
+    proc.publish_sched_info(
+      budget_deadline, window_pos.end, window_pos.major_frame, window_pos.index);
+}
+
+bool Slice::continues_in_successor(const Partition *part) const
+{
+    return successor && (successor->sc == part || successor->be == part);
 }
 
 void Slice::start_partition(Partition *part, time_point current_time, bool move_to_first_proc)
@@ -128,11 +206,16 @@ void Slice::start_partition(Partition *part, time_point current_time, bool move_
     if (part) {
         part->reset(move_to_first_proc, cpus, completion_cb_cached);
     }
-    start_next_process(current_time);
+    if (parallel_be && part == be) {
+        for (auto &lane : lanes) start_next_process(lane, current_time);
+    } else {
+        start_next_process(lanes.front(), current_time);
+    }
 }
 
-void Slice::start_sc(time_point current_time)
+void Slice::start_sc(time_point current_time, const WindowPosition &window_position)
 {
+    window_pos = window_position;
     if (!sc) {
         // if there's no SC partition, immediately signal that this slice can continue
         sc_done_cb(*this, current_time);
@@ -150,50 +233,88 @@ void Slice::start_be(time_point current_time)
     start_partition(be, current_time, false);
 }
 
-void Slice::stop(time_point current_time)
+void Slice::stop(time_point current_time, bool allow_parking)
 {
-    timer.stop();
+    for (auto &lane : lanes) dispatcher->disarm(lane.timer_slot);
     // it is OK to disconnect before stopping the running process
     if (sc) sc->disconnect();
     if (be) be->disconnect();
 
-    if (!running_process) {
-        return;
+    // a parallel BE partition would continue in multiple lanes, only a single process
+    //  can be parked
+    allow_parking = allow_parking && lanes.size() == 1;
+    for (auto &lane : lanes) {
+        if (lane.process) stop_lane(lane, current_time, allow_parking);
     }
+}
 
+void Slice::stop_lane(Lane &lane, time_point current_time, bool allow_parking)
+{
     // in case the remaining time is less than a millisecond, we round it to zero
     //  and consider the process completed; this lets us always schedule a whole number
     //  of milliseconds, which is nicer to work with (and consistent with how config
     //  exposes the times)
     using namespace std::chrono;
-    auto remaining = duration_cast<milliseconds>(timeout - current_time);
+    // the remaining budget is stored unscaled (see `PowerPolicy::get_budget_scale`)
+    auto remaining =
+      duration_cast<milliseconds>((lane.timeout - current_time) / lane.budget_scale);
 
     if (remaining == remaining.zero()) {
         // window ended approximately at the same moment when the process timed out
-        // Slice::stop is called before schedule_next due to higher timer priority
+        // Slice::stop is called before schedule_next, as the MajorFrame timer slot
+        //  is dispatched first
         // we stop the running process and load the next one (to prepare the partition
         //  for the next window); this may call sc_done_cb if this was the last process
         //  from the SC partition
         TRACE("Process ran out of budget exactly at the window end");
-        stop_current_process(true);
-        load_next_process(current_time);
-        // clear running_process set by load_next_process above, as we're not starting it now
-        running_process = nullptr;
+        Process *proc = lane.process;
+        stop_current_process(lane, current_time, true);
+        if (running_partition == sc) proc->handle_overrun();
+        load_next_process(lane, current_time);
+        // clear the process set by load_next_process above, as we're not starting it now
+        lane.process = nullptr;
         return;
     }
 
     if (running_partition == be) {
         // we're interrupting a process from the BE partition
         // store remaining budget for next run
-        running_process->set_remaining_budget(remaining);
+        lane.process->set_remaining_budget(remaining);
+    }
+
+    // an SC process interrupted by the window end did not complete in time
+    Process *overrun = running_partition == sc ? lane.process : nullptr;
+    // a process that is skipped, signalled or restarted due to the overrun must be stopped
+    using OverrunAction = Process::OverrunPolicy::Action;
+    if (overrun && overrun->get_overrun_policy().action != OverrunAction::carry_on) {
+        allow_parking = false;
     }
 
-    stop_current_process(false);
+    if (allow_parking && continues_in_successor(running_partition)) {
+        // the partition continues on the same CPUs, so there's a good chance this process
+        //  is the first one to run in the next window; keep it running until we know
+        park_current_process(lane, current_time);
+    } else {
+        stop_current_process(lane, current_time, false);
+    }
+    if (overrun) overrun->handle_overrun();
 }
 
 // Called as a response to timeout or process completion.
-void Slice::schedule_next(time_point current_time)
+void Slice::schedule_next(Lane &lane, time_point current_time, bool budget_exhausted)
 {
-    stop_current_process(true);
-    start_next_process(current_time);
+    Process *proc = lane.process;
+    stop_current_process(lane, current_time, true, budget_exhausted);
+    if (running_partition == sc) {
+        // the overrun policy is applied after the process is frozen
+        if (budget_exhausted) {
+            proc->handle_overrun();
+        } else {
+            // an activation that overran continues in the next window, so its execution
+            //  time is only known now, including the runs in the previous windows
+            proc->record_execution_time(proc->get_activation_time());
+            proc->clear_consecutive_overruns();
+        }
+    }
+    start_next_process(lane, current_time);
 }
@@ -1,17 +1,26 @@
 #pragma once
 
 #include "cpufreq_policy.hpp"
+#include "dispatcher.hpp"
 #include "lib/cpu_set.hpp"
 #include "partition.hpp"
-#include "timerfd.hpp"
 #include <chrono>
 #include <ev++.h>
 #include <functional>
+#include <vector>
 
 class PowerPolicy;
 
 using time_point = std::chrono::steady_clock::time_point;
 
+/** Position of the running window in the schedule, published to the scheduled processes. */
+struct WindowPosition
+{
+    time_point end;
+    uint64_t major_frame;
+    uint32_t index;
+};
+
 /**
  * Associates partitions/processes with a given CPU core set. Always scheduled as part of a Window.
  *
@@ -21,17 +30,21 @@ using time_point = std::chrono::steady_clock::time_point;
  *
  * First, safety-critical partition is ran; after it finishes (either its time
  * budget is exhausted, or it completes), best-effort partition is started.
+ *
+ * Processes run in lanes; normally, a slice has a single lane, so only one process runs
+ * at a time. With `parallel_be`, the BE partition runs in one lane per CPU of the slice,
+ * i.e. up to `cpus.count()` pending BE processes run at once, each pinned to its own CPU.
  */
 class Slice
 {
 public:
-    Slice(ev::loop_ref loop,
-          PowerPolicy &power_policy,
+    Slice(PowerPolicy &power_policy,
           std::function<void(Slice &, time_point)> sc_done_cb,
           Partition *sc,
           Partition *be,
           std::optional<CpuFrequencyHz> req_freq,
-          cpu_set cpus = cpu_set(0x1));
+          cpu_set cpus = cpu_set(0x1),
+          bool parallel_be = false);
 
     Slice(const Slice &) = delete;
     const Slice &operator=(const Slice &) = delete;
@@ -43,34 +56,87 @@ public:
     Partition *const be;
     const cpu_set cpus;
     const std::optional<CpuFrequencyHz> requested_frequency;
-
+    /** If true, BE processes run in parallel, one per CPU (see above). */
+    const bool parallel_be;
 
     /**
      * Starts execution of SC partition, if present. Calls sc_done_cb
      *  when done (or when SC partition is not present).
      */
-    void start_sc(time_point current_time);
+    void start_sc(time_point current_time, const WindowPosition &window_position);
     /** Starts execution of BE partition, if present. */
     void start_be(time_point current_time);
-    void stop(time_point current_time);
+    /**
+     * Stops the running process. If `allow_parking` is true and the running partition
+     * continues on the same CPUs in the next window, the process is only parked
+     * (see `Process::park()`) and keeps running; call `finish_parking()`
+     * after the next window is started to freeze it if it was not resumed.
+     */
+    void stop(time_point current_time, bool allow_parking = false);
+    void finish_parking();
+
+    /**
+     * Sets the slice from the next window which runs on the same CPUs
+     * as this one and shares a partition with it.
+     */
+    void set_successor(Slice &next)
+    {
+        successor = &next;
+        next.predecessor = this;
+    }
+
+    /** Assigns the budget timer of this slice to a slot of the shared dispatcher. */
+    void bind_timer(TimerDispatcher &timer_dispatcher);
+
+    /** How late the budget timer expirations of this slice (its first lane) were handled. */
+    [[nodiscard]] const Log2Histogram &get_timer_lateness() const
+    {
+        return dispatcher->get_lateness(lanes.front().timer_slot);
+    }
 
 private:
+    /** A single process running in the slice, with its budget timer. */
+    struct Lane
+    {
+        Process *process = nullptr;
+        // will be overwritten in start(...), value is not important
+        time_point timeout = time_point::min();
+        /** When the running process was started, used to account its consumed budget. */
+        time_point run_start = time_point::min();
+        /** Scale of the budget of the running process, see `PowerPolicy::get_budget_scale`. */
+        double budget_scale = 1;
+        TimerDispatcher::Slot timer_slot = 0;
+        /** The CPU that BE processes are pinned to with `parallel_be`. */
+        cpu_set cpu{};
+    };
+
     PowerPolicy &power_policy;
     std::function<void(Slice &, time_point)> sc_done_cb;
-    Process *running_process = nullptr;
+    /** SC partitions always run in the first lane. */
+    std::vector<Lane> lanes{};
     Partition *running_partition = nullptr;
-    // will be overwritten in start(...), value is not important
-    time_point timeout = time_point::min();
-    ev::timerfd timer;
+    /** Process that was left running at the end of the previous window, see `stop(...)`. */
+    Process *parked_process = nullptr;
+    Slice *successor = nullptr;
+    Slice *predecessor = nullptr;
+    WindowPosition window_pos{};
+    TimerDispatcher *dispatcher = nullptr;
+    /** ID of this slice in the schedule trace. */
+    const uint32_t trace_id;
     // cached, so that we don't create new std::function each time we set the callback
     Partition::CompletionCb completion_cb_cached;
 
-    void schedule_next(time_point current_time);
+    void schedule_next(Lane &lane, time_point current_time, bool budget_exhausted = false);
     void start_partition(Partition *part, time_point current_time, bool move_to_first_proc);
-    void stop_current_process(bool mark_completed);
-    bool load_next_process(time_point current_time);
-    void start_next_process(time_point current_time);
-
-public:
-    static time_point start_time; // Scheduler start time for schedule logging
+    void stop_current_process(Lane &lane,
+                              time_point current_time,
+                              bool mark_completed,
+                              bool budget_exhausted = false);
+    void stop_lane(Lane &lane, time_point current_time, bool allow_parking);
+    void park_current_process(Lane &lane, time_point current_time);
+    [[nodiscard]] bool continues_in_successor(const Partition *part) const;
+    [[nodiscard]] bool is_running(const Process &proc) const;
+    bool load_next_process(Lane &lane, time_point current_time);
+    void start_next_process(Lane &lane, time_point current_time);
+    void publish_sched_info(Process &proc, time_point budget_deadline);
 };
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "log.hpp"
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Measures the duration of consecutive startup phases (configuration parsing,
+ * cgroup setup, process spawning and initialization) and logs them as a single
+ * report, which shows where the time goes when starting many processes.
+ *
+ * Each phase starts when the previous one ends (or when the report is created).
+ */
+class StartupReport
+{
+public:
+    /** Ends the current phase and starts the next one. */
+    void end_phase(const char *name)
+    {
+        auto now = std::chrono::steady_clock::now();
+        phases.emplace_back(name, now - phase_start);
+        phase_start = now;
+    }
+
+    void log(size_t process_count) const
+    {
+        std::string msg;
+        std::chrono::nanoseconds total{ 0 };
+        for (auto &[name, duration] : phases) {
+            if (!msg.empty()) msg += ", ";
+            msg += fmt::format("{} '{:.1f} ms'", name, to_ms(duration));
+            total += duration;
+        }
+        logger->info("Startup of {} {} took '{:.1f} ms' ({})",
+                     process_count,
+                     process_count == 1 ? "process" : "processes",
+                     to_ms(total),
+                     msg);
+    }
+
+private:
+    std::chrono::steady_clock::time_point phase_start = std::chrono::steady_clock::now();
+    std::vector<std::pair<const char *, std::chrono::nanoseconds>> phases{};
+
+    static double to_ms(std::chrono::nanoseconds d)
+    {
+        return static_cast<double>(d.count()) / 1e6;
+    }
+};
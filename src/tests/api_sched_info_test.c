@@ -0,0 +1,36 @@
+#include "demos-sch.h"
+#include <err.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/** Prints the window index and major frame number in each of the first N windows. */
+int main(int argc, char *argv[])
+{
+    // disable stdout buffering to avoid synchronization issues for tests
+    setbuf(stdout, NULL);
+
+    int iterations = argc > 1 ? atoi(argv[1]) : 1;
+    for (int i = 0; i < iterations; i++) {
+        struct demos_sched_info info;
+        if (demos_get_sched_info(&info) == -1) {
+            err(1, "demos_get_sched_info");
+        }
+
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+        if (info.budget_deadline_ns <= now || info.window_end_ns <= now) {
+            errx(1, "deadline already passed while running");
+        }
+
+        printf("window %" PRIu32 " mf %" PRIu64 "\n", info.window_index, info.major_frame);
+
+        if (demos_completed() == -1) {
+            err(1, "demos_completed");
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "log.hpp"
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+/**
+ * A temporary directory standing in for a part of sysfs in unit tests; removed by the destructor.
+ *
+ * The attributes are regular files, so writes done by the tested code with `O_APPEND`, or without
+ * `O_TRUNC`, do not replace the previous content as they would in sysfs. Constructing it also
+ * initializes the global logger, which the tested classes use.
+ */
+class FakeSysfs
+{
+public:
+    explicit FakeSysfs(const std::string &name)
+    {
+        initialize_logger("%v", false, false);
+        std::string tmpl = "/tmp/demos-" + name + "-XXXXXX";
+        root = mkdtemp(tmpl.data());
+    }
+
+    ~FakeSysfs() { std::filesystem::remove_all(root); }
+
+    FakeSysfs(const FakeSysfs &) = delete;
+    FakeSysfs &operator=(const FakeSysfs &) = delete;
+
+    [[nodiscard]] const std::filesystem::path &path() const { return root; }
+
+    /** Creates or replaces the attribute at `rel_path`, including the parent directories. */
+    template<typename T>
+    void set(const std::filesystem::path &rel_path, const T &value) const
+    {
+        std::filesystem::create_directories((root / rel_path).parent_path());
+        std::ofstream(root / rel_path) << value;
+    }
+
+    /** Returns the whole content of the attribute at `rel_path`. */
+    [[nodiscard]] std::string read(const std::filesystem::path &rel_path) const
+    {
+        std::ifstream is(root / rel_path);
+        return { std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>() };
+    }
+
+    /**
+     * Creates a `cpufreq` policy directory `policy0` for CPU 0, running the `schedutil` governor,
+     * with frequencies of 600, 896 and 1200 MHz. Returns its path.
+     */
+    [[nodiscard]] std::filesystem::path add_cpufreq_policy() const
+    {
+        set("policy0/scaling_governor", "schedutil");
+        set("policy0/cpuinfo_min_freq", "600000");
+        set("policy0/cpuinfo_max_freq", "1200000");
+        set("policy0/scaling_max_freq", "1200000");
+        set("policy0/scaling_available_frequencies", "600000 896000 1200000");
+        set("policy0/affected_cpus", "0");
+        set("policy0/scaling_setspeed", "");
+        return root / "policy0";
+    }
+
+private:
+    std::filesystem::path root;
+};
@@ -0,0 +1,154 @@
+#include "trace.hpp"
+#include "lib/check_lib.hpp"
+#include "log.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+ScheduleTrace schedule_trace;
+
+using namespace std::chrono;
+
+static constexpr size_t RING_SIZE = 4096;
+/** The trace file is grown in chunks of this many records. */
+static constexpr size_t FILE_CHUNK = 16 * RING_SIZE;
+/** Size of the text log buffer, flushed at the end of each `drain()`. */
+static constexpr size_t LOG_BUF_SIZE = 64 * 1024;
+static constexpr char MAGIC[8] = "DEMOSTR";
+
+ScheduleTrace::ScheduleTrace()
+    : trace_path(getenv("DEMOS_TRACE_FILE"))
+    , log_path(getenv("DEMOS_SCHEDULE_LOG"))
+{
+    // preallocate the buffers, so that no allocation happens while the scheduler is running
+    if (is_requested()) ring.resize(RING_SIZE);
+    if (log_path) log_buf.resize(LOG_BUF_SIZE);
+}
+
+ScheduleTrace::~ScheduleTrace()
+{
+    // this runs during static destruction, we cannot throw or log anything
+    try {
+        finish();
+    } catch (...) {
+    }
+    if (file_mem) munmap(file_mem, file_size);
+    if (fd >= 0) close(fd);
+    if (log_fd >= 0) close(log_fd);
+}
+
+uint32_t ScheduleTrace::register_subject(std::string label)
+{
+    subjects.push_back(std::move(label));
+    return subjects.size() - 1;
+}
+
+void ScheduleTrace::start(steady_clock::time_point start_time_)
+{
+    if (!is_requested()) return;
+    start_time = start_time_;
+    if (trace_path) {
+        fd = CHECK_MSG(open(trace_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644),
+                       "Failed to open the trace file '" + std::string(trace_path) + "'");
+        reserve_file(FILE_CHUNK);
+        memcpy(header()->magic, MAGIC, sizeof(MAGIC));
+        header()->start_ns = start_time.time_since_epoch().count();
+        header()->record_count = 0;
+    }
+    if (log_path) {
+        log_fd = CHECK_MSG(open(log_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644),
+                           "Failed to open the schedule log '" + std::string(log_path) + "'");
+    }
+    enabled = true;
+}
+
+TraceRecord *ScheduleTrace::file_records() const
+{
+    return reinterpret_cast<TraceRecord *>(static_cast<char *>(file_mem) + sizeof(FileHeader));
+}
+
+void ScheduleTrace::reserve_file(uint64_t record_count)
+{
+    size_t size = sizeof(FileHeader) + record_count * sizeof(TraceRecord);
+    if (size <= file_size) return;
+    CHECK(ftruncate(fd, size));
+    void *mem = file_mem ? mremap(file_mem, file_size, size, MREMAP_MAYMOVE)
+                         : mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) throw IOError("Failed to map the trace file");
+    file_mem = mem;
+    file_size = size;
+}
+
+void ScheduleTrace::drain()
+{
+    if (!enabled) return;
+    uint64_t h = head.load(std::memory_order_acquire);
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    if (fd >= 0) {
+        uint64_t count = header()->record_count;
+        if (count + (h - t) > (file_size - sizeof(FileHeader)) / sizeof(TraceRecord)) {
+            reserve_file(count + (h - t) + FILE_CHUNK);
+        }
+        for (uint64_t i = t; i != h; i++) {
+            file_records()[count++] = ring[i % ring.size()];
+        }
+        header()->record_count = count;
+    }
+    if (log_fd >= 0) {
+        for (uint64_t i = t; i != h; i++) {
+            append_text_log(ring[i % ring.size()]);
+        }
+        flush_text_log();
+    }
+    tail.store(h, std::memory_order_release);
+}
+
+void ScheduleTrace::finish()
+{
+    if (!enabled) return;
+    drain();
+    enabled = false;
+    // drop the unused preallocated tail of the file
+    if (fd >= 0) {
+        CHECK(ftruncate(fd, sizeof(FileHeader) + header()->record_count * sizeof(TraceRecord)));
+    }
+    if (log_fd >= 0) {
+        close(log_fd);
+        log_fd = -1;
+    }
+}
+
+/** Formats the record in the text format of the original schedule log, if it has one. */
+void ScheduleTrace::append_text_log(const TraceRecord &r)
+{
+    if (r.event != TraceEvent::process_resume) return;
+    auto t = steady_clock::time_point(steady_clock::duration(r.scheduled_ns));
+    auto format = [&](char *out, size_t size) {
+        return fmt::format_to_n(out,
+                                size,
+                                "{:6}: cpus={} cmd='{}' budget={}\n",
+                                duration_cast<milliseconds>(t - start_time).count(),
+                                subjects[r.slice],
+                                subjects[r.subject],
+                                r.arg)
+          .size;
+    };
+    size_t len = format(log_buf.data() + log_buf_used, log_buf.size() - log_buf_used);
+    if (log_buf_used + len > log_buf.size()) {
+        flush_text_log();
+        // lines longer than the whole buffer are truncated
+        len = std::min(format(log_buf.data(), log_buf.size()), log_buf.size());
+    }
+    log_buf_used += len;
+}
+
+void ScheduleTrace::flush_text_log()
+{
+    for (size_t written = 0; written < log_buf_used;) {
+        written += static_cast<size_t>(
+          CHECK(write(log_fd, log_buf.data() + written, log_buf_used - written)));
+    }
+    log_buf_used = 0;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class TraceEvent : uint8_t
+{
+    window_start,
+    window_stop,
+    process_resume,
+    process_suspend,
+    process_completed,
+    budget_exhausted,
+    frequency_write,
+};
+
+/**
+ * Binary record of a single scheduling event.
+ *
+ * Times are `steady_clock` (CLOCK_MONOTONIC) nanoseconds; `scheduled_ns` is zero for events
+ * without a planned time (`process_suspend`). `subject` is a window index for window events,
+ * otherwise an ID returned by `ScheduleTrace::register_subject`.
+ */
+struct TraceRecord
+{
+    int64_t actual_ns;
+    int64_t scheduled_ns;
+    /** Budget in milliseconds for `process_resume`, frequency in Hz for `frequency_write`. */
+    uint64_t arg;
+    uint32_t subject;
+    /** Subject ID of the slice for process events. */
+    uint32_t slice;
+    TraceEvent event;
+};
+
+/**
+ * Schedule trace, enabled by the `DEMOS_TRACE_FILE` and/or `DEMOS_SCHEDULE_LOG`
+ * environment variables.
+ *
+ * Events are recorded into a preallocated ring buffer, without any formatting or
+ * allocation. The ring is drained by `drain()`, which the scheduler calls every
+ * `drain_interval` from a lowest-priority watcher and at exit. The drained records are
+ * appended to an mmap-ed file (`DEMOS_TRACE_FILE`) and/or converted to the text schedule
+ * log (`DEMOS_SCHEDULE_LOG`). If the ring is full, `record` drops the event and counts it
+ * (see `get_dropped()`), so that recording never delays the scheduler.
+ *
+ * The ring has a single producer and a single consumer; `head` and `tail` are published
+ * with release semantics, so that the drain can be moved to another thread without locking.
+ */
+class ScheduleTrace
+{
+public:
+    ScheduleTrace();
+    ~ScheduleTrace();
+
+    ScheduleTrace(const ScheduleTrace &) = delete;
+    const ScheduleTrace &operator=(const ScheduleTrace &) = delete;
+
+    /** How often the ring should be drained to avoid dropping events. */
+    static constexpr std::chrono::milliseconds drain_interval{ 10 };
+
+    /** True if tracing was requested; events are only recorded after `start(...)`. */
+    [[nodiscard]] bool is_requested() const { return trace_path || log_path; }
+
+    /**
+     * Registers a traced object (process, slice, cpufreq policy) and returns its ID.
+     * Must be called during setup, as it allocates.
+     */
+    uint32_t register_subject(std::string label);
+
+    [[nodiscard]] size_t subject_count() const { return subjects.size(); }
+
+    /**
+     * Unregisters the subjects registered since `subject_count()` returned `count`,
+     * e.g. by scratch objects which were already destroyed.
+     */
+    void forget_subjects(size_t count) { subjects.resize(count); }
+
+    /**
+     * Opens the trace file and/or the text log and enables recording, if requested.
+     * Times in the text log are relative to `start_time`.
+     */
+    void start(std::chrono::steady_clock::time_point start_time);
+
+    void record(TraceEvent event,
+                std::chrono::steady_clock::time_point scheduled,
+                uint32_t subject,
+                uint32_t slice = 0,
+                uint64_t arg = 0)
+    {
+        if (!enabled) return;
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == ring.size()) {
+            dropped++;
+            return;
+        }
+        ring[h % ring.size()] = { std::chrono::steady_clock::now().time_since_epoch().count(),
+                                  scheduled.time_since_epoch().count(),
+                                  arg,
+                                  subject,
+                                  slice,
+                                  event };
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    /** Moves all recorded events from the ring to the trace file and/or the text log. */
+    void drain();
+
+    /** Drains the ring and closes the trace file and the text log. */
+    void finish();
+
+    /** Number of events dropped because the ring was full. */
+    [[nodiscard]] uint64_t get_dropped() const { return dropped; }
+
+private:
+    /** Header at the start of the trace file, followed by `record_count` records. */
+    struct FileHeader
+    {
+        char magic[8];
+        int64_t start_ns;
+        uint64_t record_count;
+    };
+
+    const char *trace_path;
+    const char *log_path;
+    bool enabled = false;
+    std::vector<TraceRecord> ring{};
+    std::atomic<uint64_t> head{ 0 };
+    std::atomic<uint64_t> tail{ 0 };
+    uint64_t dropped = 0;
+    std::vector<std::string> subjects{};
+    std::chrono::steady_clock::time_point start_time{};
+
+    int fd = -1;
+    void *file_mem = nullptr;
+    size_t file_size = 0;
+
+    int log_fd = -1;
+    /** Formatted lines of the text log not written yet, preallocated like the ring. */
+    std::vector<char> log_buf{};
+    size_t log_buf_used = 0;
+
+    [[nodiscard]] FileHeader *header() const { return static_cast<FileHeader *>(file_mem); }
+    [[nodiscard]] TraceRecord *file_records() const;
+    void reserve_file(uint64_t record_count);
+    void append_text_log(const TraceRecord &r);
+    void flush_text_log();
+};
+
+/** Global schedule trace instance. */
+extern ScheduleTrace schedule_trace;
@@ -0,0 +1,99 @@
+#include "tests/acutest.h"
+
+#include "trace.hpp"
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static string read_file(const string &path)
+{
+    ifstream in(path);
+    stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static void test_text_log()
+{
+    string log_path = "/tmp/demos-trace-test-" + to_string(getpid()) + ".log";
+    string trace_path = "/tmp/demos-trace-test-" + to_string(getpid()) + ".bin";
+    setenv("DEMOS_SCHEDULE_LOG", log_path.c_str(), 1);
+    setenv("DEMOS_TRACE_FILE", trace_path.c_str(), 1);
+
+    ScheduleTrace trace;
+    uint32_t slice = trace.register_subject("0-1");
+    uint32_t proc = trace.register_subject("dummy");
+    auto start = steady_clock::now();
+    trace.start(start);
+    // more records than fit into the ring, drained periodically like by the scheduler
+    const int count = 10000;
+    for (int i = 0; i < count; i++) {
+        trace.record(TraceEvent::process_resume, start + milliseconds(i), proc, slice, 5);
+        trace.record(TraceEvent::process_suspend, {}, proc, slice);
+        if (i % 1000 == 0) trace.drain();
+    }
+    trace.finish();
+    TEST_CHECK(trace.get_dropped() == 0);
+
+    string log = read_file(log_path);
+    TEST_CHECK(log.rfind("     0: cpus=0-1 cmd='dummy' budget=5\n"
+                         "     1: cpus=0-1 cmd='dummy' budget=5\n",
+                         0) == 0);
+    TEST_CHECK(log.find("  9999: cpus=0-1 cmd='dummy' budget=5\n") != string::npos);
+
+    // header (magic, start time, record count) followed by the records
+    string bin = read_file(trace_path);
+    TEST_CHECK(bin.size() == 24 + 2 * count * sizeof(TraceRecord));
+    TEST_CHECK(bin.compare(0, 8, string("DEMOSTR\0", 8)) == 0);
+
+    unlink(log_path.c_str());
+    unlink(trace_path.c_str());
+}
+
+static void test_full_ring_drops()
+{
+    string trace_path = "/tmp/demos-trace-test-" + to_string(getpid()) + ".bin";
+    unsetenv("DEMOS_SCHEDULE_LOG");
+    setenv("DEMOS_TRACE_FILE", trace_path.c_str(), 1);
+
+    ScheduleTrace trace;
+    uint32_t proc = trace.register_subject("dummy");
+    trace.start(steady_clock::now());
+    // without draining, the events that do not fit into the ring are dropped
+    const int count = 10000;
+    for (int i = 0; i < count; i++) {
+        trace.record(TraceEvent::process_suspend, {}, proc);
+    }
+    uint64_t kept = count - trace.get_dropped();
+    TEST_CHECK(trace.get_dropped() > 0);
+    trace.drain();
+    trace.record(TraceEvent::process_suspend, {}, proc);
+    trace.finish();
+    TEST_CHECK(trace.get_dropped() == count - kept);
+
+    string bin = read_file(trace_path);
+    TEST_CHECK(bin.size() == 24 + (kept + 1) * sizeof(TraceRecord));
+    unlink(trace_path.c_str());
+}
+
+static void test_disabled()
+{
+    unsetenv("DEMOS_SCHEDULE_LOG");
+    unsetenv("DEMOS_TRACE_FILE");
+    ScheduleTrace trace;
+    TEST_CHECK(!trace.is_requested());
+    trace.start(steady_clock::now());
+    // must not crash, the ring is not even allocated
+    trace.record(TraceEvent::window_start, steady_clock::now(), 0);
+    trace.finish();
+}
+
+TEST_LIST = {
+    { "text_log", test_text_log },
+    { "full_ring_drops", test_full_ring_drops },
+    { "disabled", test_disabled },
+    { nullptr, nullptr },
+};
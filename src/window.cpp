@@ -2,16 +2,20 @@
 #include "log.hpp"
 #include "power_policy/_power_policy.hpp"
 
-Window::Window(ev::loop_ref loop_, std::chrono::milliseconds length_, PowerPolicy &power_policy)
-    : loop(loop_)
-    , power_policy(power_policy)
+Window::Window(std::chrono::milliseconds length_, PowerPolicy &power_policy, bool reclaim_slack)
+    : power_policy(power_policy)
     , length(length_)
+    , reclaim_slack(reclaim_slack)
 {}
 
-Slice &Window::add_slice(Partition *sc, Partition *be, const cpu_set &cpus, std::optional<CpuFrequencyHz> req_freq)
+Slice &Window::add_slice(Partition *sc,
+                         Partition *be,
+                         const cpu_set &cpus,
+                         std::optional<CpuFrequencyHz> req_freq,
+                         bool parallel_be)
 {
     auto sc_cb = [this](Slice &s, time_point t) { slice_sc_end_cb(s, t); };
-    return slices.emplace_back(loop, power_policy, sc_cb, sc, be, req_freq, cpus);
+    return slices.emplace_back(power_policy, sc_cb, sc, be, req_freq, cpus, parallel_be);
 }
 
 bool Window::has_sc_finished() const
@@ -19,22 +23,30 @@ bool Window::has_sc_finished() const
     return finished_sc_partitions == slices.size();
 }
 
-void Window::start(time_point current_time)
+void Window::start(time_point current_time, const WindowPosition &position)
 {
     TRACE("Starting window");
     finished_sc_partitions = 0;
-    for (auto &s : slices) {
-        s.start_sc(current_time);
-    }
     // call power policy handlers after we start the slices;
     //  this way, even if the CPU frequency switching is slow, the processes are
     //  still executing, although at an incorrect frequency;
     //  see `CpufreqPolicy::write_frequency` for more info
-    power_policy.on_window_start(*this);
-    power_policy.on_sc_start(*this);
+    // if the budgets are scaled by the frequency, it must be set before they are computed
+    bool frequency_first = power_policy.scales_budgets();
+    if (frequency_first) {
+        power_policy.on_window_start(*this);
+        power_policy.on_sc_start(*this);
+    }
+    for (auto &s : slices) {
+        s.start_sc(current_time, position);
+    }
+    if (!frequency_first) {
+        power_policy.on_window_start(*this);
+        power_policy.on_sc_start(*this);
+    }
 }
 
-void Window::stop(time_point current_time)
+void Window::stop(time_point current_time, bool allow_parking)
 {
     // this way, the previous window will run a bit longer
     //  if this call takes a long time to complete
@@ -45,12 +57,29 @@ void Window::stop(time_point current_time)
     //  by Window::stop (see slice.cpp for more details)
     stopping = true;
     for (auto &s : slices) {
-        s.stop(current_time);
+        s.stop(current_time, allow_parking);
     }
     stopping = false;
 }
 
-void Window::slice_sc_end_cb([[maybe_unused]] Slice &slice, time_point current_time)
+void Window::finish_parking()
+{
+    for (auto &s : slices) {
+        s.finish_parking();
+    }
+}
+
+void Window::prepare()
+{
+    power_policy.on_window_prepare(*this);
+}
+
+std::chrono::nanoseconds Window::get_prepare_lead_time() const
+{
+    return power_policy.get_frequency_lead_time();
+}
+
+void Window::slice_sc_end_cb(Slice &slice, time_point current_time)
 {
     finished_sc_partitions++;
 
@@ -59,18 +88,27 @@ void Window::slice_sc_end_cb([[maybe_unused]] Slice &slice, time_point current_t
         return;
     }
 
-    // option 1) run BE immediately after SC
-    // per-process frequency validation currently assumes option 2) here,
-    //  doesn't work correctly with option 1)
-    // slice->start_be(current_time);
+    // see `Window::start` for reasoning on why the handlers are called AFTER partition start
+    bool frequency_first = power_policy.scales_budgets();
+    if (reclaim_slack) {
+        // option 1) run BE immediately after SC of the same slice, so that its CPUs do not
+        //  idle while SC partitions of other slices are still running
+        TRACE("Starting BE partition of slice '{}'", slice.cpus.as_list());
+        if (frequency_first) power_policy.on_slice_be_start(slice);
+        slice.start_be(current_time);
+        if (!frequency_first) power_policy.on_slice_be_start(slice);
+        // BE partitions of all slices are running now
+        if (has_sc_finished()) power_policy.on_be_start(*this);
+        return;
+    }
 
     // option 2) wait until all SC partitions finish
     if (has_sc_finished()) {
         TRACE("Starting BE partitions");
+        if (frequency_first) power_policy.on_be_start(*this);
         for (auto &sp : slices) {
             sp.start_be(current_time);
         }
-        // see `Window::start` for reasoning on why this is called AFTER partition start
-        power_policy.on_be_start(*this);
+        if (!frequency_first) power_policy.on_be_start(*this);
     }
 }
@@ -10,6 +10,14 @@ class Window;
 class PowerPolicy;
 
 using Windows = std::list<Window>;
+
+/** Named set of windows; the major frame executes windows from a single mode at a time. */
+struct Mode
+{
+    std::string name;
+    Windows windows;
+};
+using Modes = std::list<Mode>;
 using time_point = std::chrono::steady_clock::time_point;
 
 /**
@@ -19,23 +27,40 @@ using time_point = std::chrono::steady_clock::time_point;
 class Window
 {
 private:
-    ev::loop_ref loop;
     uint64_t finished_sc_partitions = 0;
     PowerPolicy &power_policy;
     bool stopping = false;
 
 public:
     const std::chrono::milliseconds length;
+    /**
+     * If true, the BE partition of each slice starts as soon as the SC partition of the same
+     * slice finishes, instead of waiting until the SC partitions of all slices finish.
+     */
+    const bool reclaim_slack;
     // use std::list as Slice doesn't have move and copy constructors
     std::list<Slice> slices{};
 
-    Window(ev::loop_ref loop, std::chrono::milliseconds length, PowerPolicy &power_policy);
+    Window(std::chrono::milliseconds length, PowerPolicy &power_policy, bool reclaim_slack = false);
 
-    Slice &add_slice(Partition *sc, Partition *be, const cpu_set &cpus, std::optional<CpuFrequencyHz> req_freq);
+    Slice &add_slice(Partition *sc,
+                     Partition *be,
+                     const cpu_set &cpus,
+                     std::optional<CpuFrequencyHz> req_freq,
+                     bool parallel_be = false);
     [[nodiscard]] bool has_sc_finished() const;
-    void start(time_point current_time);
-    void stop(time_point current_time);
+    void start(time_point current_time, const WindowPosition &position);
+    /** See `Slice::stop` for the meaning of `allow_parking`. */
+    void stop(time_point current_time, bool allow_parking = false);
+    /** Freezes processes parked by `stop(...)` that did not continue in the next window. */
+    void finish_parking();
+    /**
+     * Called shortly before this window starts (see `PowerPolicy::on_window_prepare`),
+     * `get_prepare_lead_time()` before the start.
+     */
+    void prepare();
+    [[nodiscard]] std::chrono::nanoseconds get_prepare_lead_time() const;
 
 private:
-    void slice_sc_end_cb([[maybe_unused]] Slice &slice, time_point current_time);
+    void slice_sc_end_cb(Slice &slice, time_point current_time);
 };
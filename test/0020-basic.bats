@@ -9,6 +9,11 @@ load testlib
     run -1 demos-sched -C "{windows: [], partitions: []}"
 }
 
+@test "invalid environment variable value" {
+    DEMOS_CPUFREQ_LEAD=10ms run -1 demos-sched -C '{windows: [{length: 100, sc_partition: [ true ]}]}'
+    [[ $output =~ "Invalid value of DEMOS_CPUFREQ_LEAD: '10ms'" ]]
+}
+
 @test "executing echo hello (canonical config)" {
     run -0 demos-sched -C "{
         windows: [ {length: 50, slices: [ { cpu: 0, sc_partition: SC1 }] } ],
@@ -45,3 +50,35 @@ partitions:
 <MF>
 <WINDOW>' ]]
 }
+
+@test "SIGHUP reload keeps unchanged processes" {
+    cfg=$(mktemp)
+    cat > "$cfg" <<'EOF'
+set_cwd: no
+windows: [{length: 20, sc_partition: SC}]
+partitions:
+  - name: SC
+    processes: [{cmd: "echo started A; exec sleep 10", budget: 10}]
+EOF
+    demos-sched -c "$cfg" -t 10000 > "$BATS_TEST_TMPDIR/out" 2> "$BATS_TEST_TMPDIR/log" &
+    pid=$!
+    # SIGHUP would terminate DEmOS before its handler is installed
+    wait_for_line "$BATS_TEST_TMPDIR/log" "Starting scheduler"
+    cat > "$cfg" <<'EOF'
+set_cwd: no
+windows: [{length: 20, slices: [{cpu: all, sc_partition: SC, be_partition: BE}]}]
+partitions:
+  - name: SC
+    processes: [{cmd: "echo started A; exec sleep 10", budget: 5}]
+  - name: BE
+    processes: [{cmd: "echo started B; exec sleep 10", budget: 10}]
+EOF
+    kill -HUP $pid
+    wait_for_line "$BATS_TEST_TMPDIR/log" "New configuration applied"
+    wait_for_line "$BATS_TEST_TMPDIR/out" "started B"
+    kill $pid
+    wait $pid
+    run cat "$BATS_TEST_TMPDIR/out"
+    [[ $output = "started A
+started B" ]]
+}
@@ -16,6 +16,36 @@ bats_load_library bats-assert
     [[ ${lines[1]} = "second" ]]
 }
 
+@test "futex_yield schedules iterations of the sub-process" {
+    run -0 --separate-stderr timeout 3s demos-sched -m "<win>" -C "{
+    windows: [ {length: 50, slices: [ { cpu: 0, sc_partition: SC1 }] } ],
+    partitions: [ { name: SC1, processes: [ { cmd: api-test 1 2 3, budget: 20, futex_yield: yes } ] } ]
+}"
+    assert_output - <<EOF
+<win>
+1
+<win>
+2
+<win>
+3
+<win>
+EOF
+}
+
+@test "process can read its window position from the scheduling info page" {
+    run -0 --separate-stderr timeout 3s demos-sched -C "{
+    windows: [ {length: 50, slices: [ { cpu: 0, sc_partition: SC1 }] },
+               {length: 50, slices: [ { cpu: 0, sc_partition: SC1 }] } ],
+    partitions: [ { name: SC1, processes: [ { cmd: api-sched-info-test 4, budget: 20 } ] } ]
+}"
+    assert_output - <<EOF
+window 0 mf 0
+window 1 mf 0
+window 0 mf 1
+window 1 mf 1
+EOF
+}
+
 @test "demos doesn't hang when process exits during initialization" {
 # 3 seconds should be long enough, but fundamentally, it's a race condition
     run -0 timeout 3s demos-sched -C '
@@ -239,3 +239,85 @@ windows:
 @test "config from FIFO file is not accepted without 'set_cwd: false'" {
     run -1 demos-sched -d -c <(echo "{}")
 }
+
+@test "windows grouped into modes" {
+    test_normalization \
+"{
+    partitions: [ {name: SC, processes: [{cmd: echo, budget: 10}]} ],
+    windows: {
+        normal: [ {length: 20, sc_partition: SC} ],
+        degraded: [ {length: 50, slices: [{cpu: 0, be_partition: SC}]} ],
+    }
+}" \
+"set_cwd: false
+demos_cpu: all
+partitions:
+  - name: SC
+    processes:
+      - cmd: echo
+        budget: 10
+        jitter: 0
+        init: false
+windows:
+  normal:
+    - length: 20
+      slices:
+        - cpu: all
+          sc_partition: SC
+  degraded:
+    - length: 50
+      slices:
+        - cpu: 0
+          be_partition: SC"
+}
+
+@test "reference_frequency is kept in the normalized config" {
+    run -0 demos-sched -d -C "{reference_frequency: 1200}"
+    [[ $output =~ "reference_frequency: 1200" ]]
+}
+
+@test "reclaim_slack is kept in the normalized config" {
+    run -0 demos-sched -d -C "{reclaim_slack: true}"
+    [[ $output =~ "reclaim_slack: true" ]]
+}
+
+@test "non-positive reference_frequency causes an error" {
+    run -1 demos-sched -C "{reference_frequency: 0}"
+    [[ $output =~ "must be positive" ]]
+}
+
+@test "adaptive_budget is normalized to a mapping" {
+    run -0 demos-sched -d -C "{partitions: [{name: SC, processes: [{cmd: echo, budget: 100, adaptive_budget: {margin: 20}}]}]}"
+    [[ $output =~ "percentile: 95" ]]
+    [[ $output =~ "margin: 20" ]]
+    [[ $output =~ "min_budget: 1" ]]
+}
+
+@test "adaptive_budget cannot be combined with jitter" {
+    run -1 demos-sched -C "{partitions: [{name: SC, processes: [{cmd: echo, budget: 100, jitter: 10, adaptive_budget: true}]}]}"
+    [[ $output =~ "cannot be combined with 'jitter'" ]]
+}
+
+@test "on_overrun is normalized to a mapping" {
+    run -0 demos-sched -d -C "{partitions: [{name: SC, processes: [{cmd: echo, budget: 100, on_overrun: restart}]}]}"
+    [[ $output =~ "on_overrun:
+          action: restart
+          restart_after: 1" ]]
+    run -0 demos-sched -d -C "{partitions: [{name: SC, processes: [{cmd: echo, budget: 100, on_overrun: continue}]}]}"
+    [[ ! $output =~ "on_overrun" ]]
+}
+
+@test "on_overrun signal must be known" {
+    run -1 demos-sched -C "{partitions: [{name: SC, processes: [{cmd: echo, budget: 100, on_overrun: {action: signal, signal: SIGFOO}}]}]}"
+    [[ $output =~ "Unknown signal" ]]
+}
+
+@test "unknown be_scheduling causes an error" {
+    run -1 demos-sched -C "{partitions: [{name: BE, be_scheduling: fifo, processes: [{cmd: echo, budget: 100}]}]}"
+    [[ $output =~ "Unknown be_scheduling" ]]
+}
+
+@test "non-positive process weight causes an error" {
+    run -1 demos-sched -C "{partitions: [{name: BE, processes: [{cmd: echo, budget: 100, weight: 0}]}]}"
+    [[ $output =~ "weight must be between" ]]
+}
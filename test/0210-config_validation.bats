@@ -40,3 +40,13 @@ test_validation_fail() {
     ],
 }" "overlapping CPU sets"
 }
+
+@test "unknown partition in a mode fails" {
+    test_validation_fail "{
+    windows: {
+        normal: [{length: 1, cpu: 0, sc_partition: SC}],
+        degraded: [{length: 1, cpu: 0, sc_partition: NON_EXISTENT}],
+    },
+    partitions: [{name: SC, processes: {cmd: echo, budget: 1}}],
+}" "unknown partition 'NON_EXISTENT' in window #0 of mode 'degraded'"
+}
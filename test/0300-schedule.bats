@@ -2,10 +2,6 @@
 load testlib
 
 setup() {
-    run -0 demos-sched -V
-    if ! [[ $output =~ "debug" ]]; then
-        skip "DEMOS_SCHEDULE_LOG not supported in release builds"
-    fi
     export DEMOS_SCHEDULE_LOG=demos-schedule.log
 }
 
@@ -113,6 +109,88 @@ windows:
     20: cpus=1 cmd='dummy SC2' budget=3"
 }
 
+@test "BE starts right after SC of the same slice with reclaim_slack" {
+    run -0 demos-sched -t 20 -C '
+reclaim_slack: true
+windows:
+  - length: 10
+    slices:
+      - cpu: 0
+        sc_partition: {cmd: dummy SC1, budget: 5}
+      - cpu: 1
+        sc_partition: {cmd: dummy SC2, budget: 3}
+        be_partition: {cmd: dummy BE_,  budget: 2}
+'
+    expect_schedule_log "\
+     0: cpus=0 cmd='dummy SC1' budget=5
+     0: cpus=1 cmd='dummy SC2' budget=3
+     3: cpus=1 cmd='dummy BE_' budget=2
+    10: cpus=0 cmd='dummy SC1' budget=5
+    10: cpus=1 cmd='dummy SC2' budget=3
+    13: cpus=1 cmd='dummy BE_' budget=2
+    20: cpus=0 cmd='dummy SC1' budget=5
+    20: cpus=1 cmd='dummy SC2' budget=3"
+}
+
+@test "Parallel BE runs one process per CPU" {
+    run -0 demos-sched -t 20 -C '
+windows:
+  - length: 10
+    slices:
+      - cpu: 0-1
+        parallel_be: true
+        be_partition:
+          - {cmd: dummy 1, budget: 3}
+          - {cmd: dummy 2, budget: 5}
+          - {cmd: dummy 3, budget: 4}
+'
+    expect_schedule_log "\
+     0: cpus=0-1 cmd='dummy 1' budget=3
+     0: cpus=0-1 cmd='dummy 2' budget=5
+     3: cpus=0-1 cmd='dummy 3' budget=4
+    10: cpus=0-1 cmd='dummy 3' budget=4
+    10: cpus=0-1 cmd='dummy 1' budget=3
+    13: cpus=0-1 cmd='dummy 2' budget=5
+    20: cpus=0-1 cmd='dummy 2' budget=5
+    20: cpus=0-1 cmd='dummy 3' budget=4"
+}
+
+@test "SC process with on_overrun: skip is started again after an overrun" {
+    run -0 demos-sched -t 100 -C '
+windows:
+  - length: 50
+    cpu: 0
+    sc_partition:
+      - {cmd: echo started; dummy SC1, budget: 3, on_overrun: skip}
+      - {cmd: dummy SC2, budget: 3}
+'
+    # the discarded activation is not resumed, the process is started again instead
+    [[ $(grep -c started <<<"$output") -ge 2 ]]
+}
+
+@test "BE partition with stride scheduling follows process weights" {
+    run -0 demos-sched -t 40 -C '
+partitions:
+  - name: BE
+    be_scheduling: stride
+    processes:
+      - {cmd: dummy A, budget: 5, weight: 3}
+      - {cmd: dummy B, budget: 5}
+windows:
+  - {length: 5, cpu: 0, be_partition: BE}
+'
+    expect_schedule_log "\
+     0: cpus=0 cmd='dummy A' budget=5
+     5: cpus=0 cmd='dummy B' budget=5
+    10: cpus=0 cmd='dummy A' budget=5
+    15: cpus=0 cmd='dummy A' budget=5
+    20: cpus=0 cmd='dummy A' budget=5
+    25: cpus=0 cmd='dummy B' budget=5
+    30: cpus=0 cmd='dummy A' budget=5
+    35: cpus=0 cmd='dummy A' budget=5
+    40: cpus=0 cmd='dummy A' budget=5"
+}
+
 @test "BE with budget continues in the next window" {
     run -0 demos-sched -t 20 -C '
 partitions: